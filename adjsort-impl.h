@@ -0,0 +1,284 @@
+/* -*- mode: C; mode: folding; fill-column: 70; -*- */
+/* See COPYING for license. */
+/* Body of the adjacency sort engine, included by adjsort.c once per
+   vertex ID width with VTYPE, UTYPE, VTYPE_MAX and SFX() defined. */
+
+static inline void
+SFX(cswap) (VTYPE *a, VTYPE *b)
+{
+  const VTYPE x = *a, y = *b;
+  *a = (x < y? x : y);
+  *b = (x < y? y : x);
+}
+
+/* Batcher's odd-even merge sort network on n = 2^k entries.  The
+   compare-exchanges are branch-free. */
+static void
+SFX(network_sort) (VTYPE *a, int n)
+{
+  int p, k, j, i;
+  for (p = 1; p < n; p += p)
+    for (k = p; k >= 1; k /= 2)
+      for (j = k % p; j + k < n; j += 2*k)
+	for (i = 0; i < k && i + j + k < n; ++i)
+	  if ((i + j) / (2*p) == (i + j + k) / (2*p))
+	    SFX(cswap) (&a[i+j], &a[i+j+k]);
+}
+
+static void
+SFX(short_sort) (VTYPE *list, int64_t n)
+{
+  VTYPE buf[NETWORK_MAX];
+  int m = 2, k;
+  while (m < n) m += m;
+  for (k = 0; k < n; ++k)
+    buf[k] = list[k];
+  for (; k < m; ++k)
+    buf[k] = VTYPE_MAX;
+  SFX(network_sort) (buf, m);
+  for (k = 0; k < n; ++k)
+    list[k] = buf[k];
+}
+
+static void
+SFX(insertion_sort) (VTYPE *a, int64_t n)
+{
+  int64_t k, j;
+  for (k = 1; k < n; ++k) {
+    const VTYPE x = a[k];
+    for (j = k; j > 0 && a[j-1] > x; --j)
+      a[j] = a[j-1];
+    a[j] = x;
+  }
+}
+
+static void SFX(radix_sort) (VTYPE *a, int64_t n);
+
+static void
+SFX(sort) (VTYPE *a, int64_t n)
+{
+  if (n < 2) return;
+  if (n <= NETWORK_MAX)
+    SFX(short_sort) (a, n);
+  else if (n <= INSERTION_MAX)
+    SFX(insertion_sort) (a, n);
+  else
+    SFX(radix_sort) (a, n);
+}
+
+/* In-place MSD radix (American flag) sort on the highest byte in
+   which the entries differ; buckets recurse through sort(). */
+static void
+SFX(radix_sort) (VTYPE *a, int64_t n)
+{
+  int64_t cnt[NBUCKET], next[NBUCKET], end[NBUCKET];
+  UTYPE diff = 0;
+  int64_t k, acc;
+  int shift, b;
+
+  for (k = 1; k < n; ++k)
+    diff |= (UTYPE)a[k] ^ (UTYPE)a[0];
+  if (!diff) return;
+  shift = (highest_bit (diff) / RADIX_BITS) * RADIX_BITS;
+
+#define DIGIT(x) ((int)(((UTYPE)(x) >> shift) & (NBUCKET-1)))
+  memset (cnt, 0, sizeof (cnt));
+  for (k = 0; k < n; ++k)
+    ++cnt[DIGIT(a[k])];
+  acc = 0;
+  for (b = 0; b < NBUCKET; ++b) {
+    next[b] = acc;
+    acc += cnt[b];
+    end[b] = acc;
+  }
+  for (b = 0; b < NBUCKET; ++b) {
+    while (next[b] < end[b]) {
+      VTYPE x = a[next[b]];
+      int d = DIGIT(x);
+      while (d != b) {
+	const VTYPE t = a[next[d]];
+	a[next[d]++] = x;
+	x = t;
+	d = DIGIT(x);
+      }
+      a[next[b]++] = x;
+    }
+  }
+#undef DIGIT
+  if (!shift) return;
+  for (b = 0; b < NBUCKET; ++b)
+    SFX(sort) (&a[end[b] - cnt[b]], cnt[b]);
+}
+
+static int64_t
+SFX(unique) (VTYPE *a, int64_t n)
+{
+  int64_t kcur = 0, k;
+  if (!n) return 0;
+  for (k = 1; k < n; ++k)
+    if (a[k] != a[kcur])
+      a[++kcur] = a[k];
+  return kcur + 1;
+}
+
+int64_t
+SFX(adjsort_dedup) (VTYPE *list, int64_t n)
+{
+  SFX(sort) (list, n);
+  return SFX(unique) (list, n);
+}
+
+static int
+SFX(cmp) (const void *a, const void *b)
+{
+  const VTYPE ia = *(const VTYPE*)a;
+  const VTYPE ib = *(const VTYPE*)b;
+  if (ia < ib) return -1;
+  if (ia > ib) return 1;
+  return 0;
+}
+
+static void
+SFX(pack_list) (int64_t *xoff, VTYPE *xadj, int64_t v, int use_qsort)
+{
+  const int64_t beg = xoff[2*v], n = xoff[2*v+1] - beg;
+  int64_t kcur, k;
+  if (n < 2) return;
+  if (use_qsort) {
+    qsort (&xadj[beg], n, sizeof (*xadj), SFX(cmp));
+    kcur = SFX(unique) (&xadj[beg], n);
+  } else
+    kcur = SFX(adjsort_dedup) (&xadj[beg], n);
+  for (k = kcur; k < n; ++k)
+    xadj[beg + k] = -1;
+  xoff[2*v+1] = beg + kcur;
+}
+
+/* Team-shared state for splitting hub lists across threads. */
+static struct {
+  int64_t nhub, *hub;
+  VTYPE *tmp;
+  UTYPE *diff;
+  int64_t *hist, bstart[NBUCKET+1], ucnt[NBUCKET], uoff[NBUCKET+1];
+} SFX(team);
+
+/* Sort one hub list with every thread: partition on the highest
+   differing byte into a scratch buffer, sort and deduplicate the
+   buckets independently, and compact them back. */
+static void
+SFX(pack_hub) (int64_t *xoff, VTYPE *xadj, int64_t v)
+{
+  const int nt = omp_get_num_threads (), tid = omp_get_thread_num ();
+  const int64_t beg = xoff[2*v], n = xoff[2*v+1] - beg;
+  const int64_t kb = n * tid / nt, ke = n * (tid+1) / nt;
+  VTYPE * restrict a = &xadj[beg];
+  VTYPE * restrict tmp = SFX(team).tmp;
+  int64_t * restrict cnt = &SFX(team).hist[tid * NBUCKET];
+  UTYPE diff = 0;
+  int64_t k;
+  int shift, b, t;
+
+  for (k = kb; k < ke; ++k)
+    diff |= (UTYPE)a[k] ^ (UTYPE)a[0];
+  SFX(team).diff[tid] = diff;
+  OMP("omp barrier");
+  for (t = 0; t < nt; ++t)
+    diff |= SFX(team).diff[t];
+  shift = (diff? (highest_bit (diff) / RADIX_BITS) * RADIX_BITS : 0);
+
+#define DIGIT(x) ((int)(((UTYPE)(x) >> shift) & (NBUCKET-1)))
+  for (b = 0; b < NBUCKET; ++b)
+    cnt[b] = 0;
+  for (k = kb; k < ke; ++k)
+    ++cnt[DIGIT(a[k])];
+  OMP("omp barrier");
+  OMP("omp single") {
+    int64_t acc = 0;
+    for (b = 0; b < NBUCKET; ++b) {
+      SFX(team).bstart[b] = acc;
+      for (t = 0; t < nt; ++t) {
+	const int64_t c = SFX(team).hist[t * NBUCKET + b];
+	SFX(team).hist[t * NBUCKET + b] = acc;
+	acc += c;
+      }
+    }
+    SFX(team).bstart[NBUCKET] = acc;
+  }
+  for (k = kb; k < ke; ++k)
+    tmp[cnt[DIGIT(a[k])]++] = a[k];
+#undef DIGIT
+  OMP("omp barrier");
+
+  OMP("omp for schedule(dynamic,1)")
+    for (b = 0; b < NBUCKET; ++b)
+      SFX(team).ucnt[b] = SFX(adjsort_dedup) (&tmp[SFX(team).bstart[b]],
+					       SFX(team).bstart[b+1] - SFX(team).bstart[b]);
+  OMP("omp single") {
+    SFX(team).uoff[0] = 0;
+    for (b = 0; b < NBUCKET; ++b)
+      SFX(team).uoff[b+1] = SFX(team).uoff[b] + SFX(team).ucnt[b];
+  }
+  OMP("omp for schedule(dynamic,1)")
+    for (b = 0; b < NBUCKET; ++b)
+      memcpy (&a[SFX(team).uoff[b]], &tmp[SFX(team).bstart[b]],
+	      SFX(team).ucnt[b] * sizeof (*a));
+  OMP("omp for")
+    for (k = SFX(team).uoff[NBUCKET]; k < n; ++k)
+      a[k] = -1;
+  OMP("omp single")
+    xoff[2*v+1] = beg + SFX(team).uoff[NBUCKET];
+}
+
+void
+SFX(adjsort_pack) (int64_t nv, int64_t *xoff, VTYPE *xadj, int use_qsort)
+{
+  const int nt = omp_get_num_threads ();
+  const int split = (nt > 1 && !use_qsort);
+  int64_t v, h;
+
+  OMP("omp single") {
+    SFX(team).nhub = 0;
+    SFX(team).hub = NULL;
+    if (split)
+      SFX(team).hub = xmalloc ((xoff[2*nv] / ADJSORT_HUB_LEN + 1)
+			       * sizeof (*SFX(team).hub));
+  }
+
+  OMP("omp for schedule(dynamic,256)")
+    for (v = 0; v < nv; ++v) {
+      if (split && xoff[2*v+1] - xoff[2*v] > ADJSORT_HUB_LEN) {
+	int64_t where;
+	OMP("omp atomic capture")
+	  where = SFX(team).nhub++;
+	SFX(team).hub[where] = v;
+      } else
+	SFX(pack_list) (xoff, xadj, v, use_qsort);
+    }
+
+  if (!split) return;
+
+  OMP("omp single") {
+    int64_t maxlen = 0;
+    for (h = 0; h < SFX(team).nhub; ++h) {
+      const int64_t u = SFX(team).hub[h];
+      if (xoff[2*u+1] - xoff[2*u] > maxlen)
+	maxlen = xoff[2*u+1] - xoff[2*u];
+    }
+    SFX(team).tmp = NULL;
+    if (maxlen) {
+      SFX(team).tmp = xmalloc_large (maxlen * sizeof (*SFX(team).tmp));
+      SFX(team).diff = xmalloc (nt * sizeof (*SFX(team).diff));
+      SFX(team).hist = xmalloc (nt * NBUCKET * sizeof (*SFX(team).hist));
+    }
+  }
+  for (h = 0; h < SFX(team).nhub; ++h)
+    SFX(pack_hub) (xoff, xadj, SFX(team).hub[h]);
+  OMP("omp single") {
+    if (SFX(team).tmp) {
+      xfree_large (SFX(team).tmp);
+      free (SFX(team).diff);
+      free (SFX(team).hist);
+    }
+    free (SFX(team).hub);
+  }
+}
@@ -0,0 +1,44 @@
+/* -*- mode: C; mode: folding; fill-column: 70; -*- */
+/* See COPYING for license. */
+#include "compat.h"
+#include <stdlib.h>
+#include <string.h>
+
+#include "xalloc.h"
+#include "adjsort.h"
+
+#define NETWORK_MAX 16
+#define INSERTION_MAX 64
+#define RADIX_BITS 8
+#define NBUCKET (1<<RADIX_BITS)
+
+static int
+highest_bit (uint64_t x)
+{
+  int out = -1;
+  while (x) {
+    x >>= 1;
+    ++out;
+  }
+  return out;
+}
+
+#define VTYPE int64_t
+#define UTYPE uint64_t
+#define VTYPE_MAX INT64_MAX
+#define SFX(name) name##_i64
+#include "adjsort-impl.h"
+#undef VTYPE
+#undef UTYPE
+#undef VTYPE_MAX
+#undef SFX
+
+#define VTYPE int32_t
+#define UTYPE uint32_t
+#define VTYPE_MAX INT32_MAX
+#define SFX(name) name##_i32
+#include "adjsort-impl.h"
+#undef VTYPE
+#undef UTYPE
+#undef VTYPE_MAX
+#undef SFX
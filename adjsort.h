@@ -0,0 +1,28 @@
+/* -*- mode: C; mode: folding; fill-column: 70; -*- */
+/* See COPYING for license. */
+#if !defined(ADJSORT_HEADER_)
+#define ADJSORT_HEADER_
+
+#include "compat.h"
+
+/** Sort and deduplicate every adjacency list of an interleaved CSR,
+    where list v occupies xadj[xoff[2*v] .. xoff[2*v+1]).  Freed slots
+    are set to -1 and the end offsets are lowered.  Short lists use
+    sorting networks, long lists an in-place radix sort, and lists
+    longer than ADJSORT_HUB_LEN are split across the whole team.  Call
+    from every thread of a parallel region, or sequentially.  With
+    use_qsort, fall back to libc qsort per list for comparison. */
+void adjsort_pack_i64 (int64_t nv, int64_t *xoff, int64_t *xadj,
+		       int use_qsort);
+void adjsort_pack_i32 (int64_t nv, int64_t *xoff, int32_t *xadj,
+		       int use_qsort);
+
+/** Sort and deduplicate one list in place, return its new length. */
+int64_t adjsort_dedup_i64 (int64_t *list, int64_t n);
+int64_t adjsort_dedup_i32 (int32_t *list, int64_t n);
+
+#if !defined(ADJSORT_HUB_LEN)
+#define ADJSORT_HUB_LEN ((int64_t)1<<16)
+#endif
+
+#endif /* ADJSORT_HEADER_ */
@@ -0,0 +1,150 @@
+/* -*- mode: C; mode: folding; fill-column: 70; -*- */
+/* See COPYING for license. */
+#include "compat.h"
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "graph500.h"
+#include "bfstrace.h"
+
+int bfs_trace_on = 0;
+
+static const char *trace_path;
+
+struct trace_bfs {
+  int64_t root, nedge;
+  double time;
+  int64_t lvl0, nlvl;
+};
+
+struct trace_lvl {
+  struct bfs_trace_level lvl;
+  int64_t thr0;
+  int nthread, has_edges;
+};
+
+static struct trace_bfs *tbfs;
+static int64_t ntbfs, sztbfs, cur = -1;
+static struct trace_lvl *tlvl;
+static int64_t ntlvl, sztlvl;
+static double *tthr;
+static int64_t *tedge;
+static int64_t ntthr, sztthr, sztedge;
+
+static void *
+grow (void *p, int64_t *sz, int64_t need, size_t elsz)
+{
+  if (need > *sz) {
+    *sz = 2 * need + 64;
+    if (!(p = realloc (p, *sz * elsz))) {
+      fprintf (stderr, "Out of memory for the BFS trace.\n");
+      abort ();
+    }
+  }
+  return p;
+}
+
+void
+bfs_trace_init (void)
+{
+  trace_path = getenv ("BFS_TRACE");
+  bfs_trace_on = trace_path && *trace_path;
+}
+
+void
+bfs_trace_begin (int64_t root)
+{
+  if (!bfs_trace_on) return;
+  tbfs = grow (tbfs, &sztbfs, ntbfs + 1, sizeof (*tbfs));
+  cur = ntbfs++;
+  tbfs[cur].root = root;
+  tbfs[cur].nedge = -1;
+  tbfs[cur].time = 0;
+  tbfs[cur].lvl0 = ntlvl;
+  tbfs[cur].nlvl = 0;
+}
+
+void
+bfs_trace_level (const struct bfs_trace_level *lvl,
+		 const double *thread_time,
+		 const int64_t *thread_edges, int nthread)
+{
+  int k;
+  if (!bfs_trace_on || cur < 0) return;
+  tlvl = grow (tlvl, &sztlvl, ntlvl + 1, sizeof (*tlvl));
+  tthr = grow (tthr, &sztthr, ntthr + nthread, sizeof (*tthr));
+  tedge = grow (tedge, &sztedge, ntthr + nthread, sizeof (*tedge));
+  tlvl[ntlvl].lvl = *lvl;
+  tlvl[ntlvl].thr0 = ntthr;
+  tlvl[ntlvl].nthread = nthread;
+  tlvl[ntlvl].has_edges = thread_edges != NULL;
+  for (k = 0; k < nthread; ++k) {
+    tthr[ntthr] = thread_time[k];
+    tedge[ntthr++] = (thread_edges? thread_edges[k] : -1);
+  }
+  ++ntlvl;
+  ++tbfs[cur].nlvl;
+}
+
+void
+bfs_trace_end (double time, int64_t nedge)
+{
+  if (!bfs_trace_on || cur < 0) return;
+  tbfs[cur].time = time;
+  tbfs[cur].nedge = nedge;
+  cur = -1;
+}
+
+static void
+put_count (FILE *f, const char *key, int64_t x)
+{
+  if (x >= 0)
+    fprintf (f, ", \"%s\": %" PRId64, key, x);
+  else
+    fprintf (f, ", \"%s\": null", key);
+}
+
+void
+bfs_trace_write (void)
+{
+  FILE *f;
+  int64_t b, l;
+  int k;
+
+  if (!bfs_trace_on) return;
+  if (!(f = fopen (trace_path, "w"))) {
+    perror ("Cannot write the BFS trace");
+    return;
+  }
+  fprintf (f, "{\"bfs\": [");
+  for (b = 0; b < ntbfs; ++b) {
+    fprintf (f, "%s\n {\"root\": %" PRId64 ", \"time\": %.9e",
+	     (b? "," : ""), tbfs[b].root, tbfs[b].time);
+    put_count (f, "nedge", tbfs[b].nedge);
+    fprintf (f, ", \"levels\": [");
+    for (l = tbfs[b].lvl0; l < tbfs[b].lvl0 + tbfs[b].nlvl; ++l) {
+      const struct bfs_trace_level *lvl = &tlvl[l].lvl;
+      fprintf (f, "%s\n  {\"dir\": \"%s\"", (l > tbfs[b].lvl0? "," : ""),
+	       (lvl->dir == BFS_TRACE_TOP_DOWN? "top-down" : "bottom-up"));
+      put_count (f, "frontier", lvl->frontier);
+      put_count (f, "scout", lvl->scout);
+      put_count (f, "checked", lvl->checked);
+      put_count (f, "awake", lvl->awake);
+      fprintf (f, ", \"time\": %.9e, \"thread_time\": [", lvl->time);
+      for (k = 0; k < tlvl[l].nthread; ++k)
+	fprintf (f, "%s%.9e", (k? ", " : ""), tthr[tlvl[l].thr0 + k]);
+      fprintf (f, "]");
+      if (tlvl[l].has_edges) {
+	fprintf (f, ", \"thread_edges\": [");
+	for (k = 0; k < tlvl[l].nthread; ++k)
+	  fprintf (f, "%s%" PRId64, (k? ", " : ""), tedge[tlvl[l].thr0 + k]);
+	fprintf (f, "]");
+      }
+      fprintf (f, "}");
+    }
+    fprintf (f, "]}");
+  }
+  fprintf (f, "\n]}\n");
+  fclose (f);
+  report_result ("bfs_trace: %s", trace_path);
+}
@@ -0,0 +1,46 @@
+/* -*- mode: C; mode: folding; fill-column: 70; -*- */
+/* See COPYING for license. */
+#if !defined(BFSTRACE_HEADER_)
+#define BFSTRACE_HEADER_
+
+#include "compat.h"
+
+/* Per-level BFS tracing, enabled by BFS_TRACE=<file>.  The driver
+   brackets each timed make_bfs_tree with bfs_trace_begin and
+   bfs_trace_end and writes the trace as JSON with the results.
+   Implementations test bfs_trace_on before timing anything, so a
+   disabled trace costs one test per level. */
+
+extern int bfs_trace_on;
+
+enum { BFS_TRACE_TOP_DOWN, BFS_TRACE_BOTTOM_UP };
+
+struct bfs_trace_level {
+  int dir;
+  int64_t frontier; /* vertices in the level's input frontier */
+  int64_t scout;    /* edges out of that frontier, < 0 if unknown */
+  int64_t checked;  /* edges examined */
+  int64_t awake;    /* vertices discovered */
+  double time;
+};
+
+/** Read BFS_TRACE and set bfs_trace_on. */
+void bfs_trace_init (void);
+
+/** Start recording the search from root. */
+void bfs_trace_begin (int64_t root);
+
+/** Record a level of the current search, with each thread's busy
+    time and, unless thread_edges is NULL, the edges it examined.
+    Ignored outside begin/end. */
+void bfs_trace_level (const struct bfs_trace_level *lvl,
+		      const double *thread_time,
+		      const int64_t *thread_edges, int nthread);
+
+/** Finish the current search. */
+void bfs_trace_end (double time, int64_t nedge);
+
+/** Write the JSON trace and report its file name. */
+void bfs_trace_write (void);
+
+#endif /* BFSTRACE_HEADER_ */
@@ -0,0 +1,131 @@
+/* -*- mode: C; mode: folding; fill-column: 70; -*- */
+/* See COPYING for license. */
+#include "compat.h"
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <sys/mman.h>
+
+#include "bitmap.h"
+
+#define HUGE_PAGE (2*1024*1024)
+
+int
+bm_alloc (bitmap_t *bm, int64_t nbit)
+{
+  const int64_t nw = (nbit + 63) / 64;
+  const size_t sz = (nw? nw : 1) * sizeof (*bm->start);
+  void *p = NULL;
+
+  if (sz >= HUGE_PAGE) {
+    if (posix_memalign (&p, HUGE_PAGE, (sz + HUGE_PAGE - 1) & ~(size_t)(HUGE_PAGE - 1)))
+      p = NULL;
+#if defined(MADV_HUGEPAGE)
+    else
+      madvise (p, sz, MADV_HUGEPAGE);
+#endif
+  } else
+    p = malloc (sz);
+  bm->start = p;
+  bm->end = (p? bm->start + nw : NULL);
+  return (p? 0 : -1);
+}
+
+int
+bm_init (bitmap_t *bm, int64_t nbit)
+{
+  if (bm_alloc (bm, nbit)) return -1;
+  bm_reset (bm);
+  return 0;
+}
+
+void
+bm_free (bitmap_t *bm)
+{
+  free (bm->start);
+  bm->start = bm->end = NULL;
+}
+
+void
+bm_reset (bitmap_t *bm)
+{
+  const int64_t nw = bm->end - bm->start;
+  int64_t k;
+  OMP("omp for")
+    for (k = 0; k < nw; ++k)
+      bm->start[k] = 0;
+}
+
+int64_t
+bm_count (const bitmap_t *bm)
+{
+  const int64_t nw = bm->end - bm->start;
+  static int64_t n;
+  int64_t k;
+  OMP("omp single")
+    n = 0;
+  OMP("omp for reduction(+ : n)")
+    for (k = 0; k < nw; ++k)
+      n += bm_word_popcount (bm->start[k]);
+  k = n;
+  OMP("omp barrier");
+  return k;
+}
+
+/* Prefix sums of the per-thread counts for bm_to_queue. */
+static int64_t *scan;
+static int nscan;
+
+/* This thread's static share of the words and the offset of its
+   first set bit among all set bits.  Returns the total. */
+static int64_t
+share_offset (const bitmap_t *bm, int64_t *w0, int64_t *w1, int64_t *off)
+{
+  const int64_t nw = bm->end - bm->start;
+  const int nt = omp_get_num_threads (), t = omp_get_thread_num ();
+  int64_t k, n = 0;
+
+  *w0 = (nw * t) / nt;
+  *w1 = (nw * (t+1)) / nt;
+  OMP("omp single") {
+    if (nscan < nt + 1) {
+      free (scan);
+      scan = malloc ((nt + 1) * sizeof (*scan));
+      if (!scan) {
+	fprintf (stderr, "Cannot allocate bitmap scan space.\n");
+	abort ();
+      }
+      nscan = nt + 1;
+    }
+  }
+  for (k = *w0; k < *w1; ++k)
+    n += bm_word_popcount (bm->start[k]);
+  scan[t+1] = n;
+  OMP("omp barrier");
+  OMP("omp single") {
+    scan[0] = 0;
+    for (k = 1; k <= nt; ++k)
+      scan[k] += scan[k-1];
+  }
+  *off = scan[t];
+  return scan[nt];
+}
+
+/* bm_to_queue for each queue element type, from one body. */
+#define BM_TO_QUEUE(NAME, T)						\
+  int64_t								\
+  NAME (const bitmap_t *bm, T *queue)					\
+  {									\
+    int64_t w0, w1, off, k, n;						\
+    n = share_offset (bm, &w0, &w1, &off);				\
+    for (k = w0; k < w1; ++k) {						\
+      uint64_t w = bm->start[k];					\
+      for (; w; w &= w - 1)						\
+	queue[off++] = 64 * k + bm_word_ctz (w);			\
+    }									\
+    OMP("omp barrier");							\
+    return n;								\
+  }
+
+BM_TO_QUEUE(bm_to_queue, int64_t)
+BM_TO_QUEUE(bm_to_queue_i32, int32_t)
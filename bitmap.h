@@ -0,0 +1,137 @@
+/* -*- mode: C; mode: folding; fill-column: 70; -*- */
+/* See COPYING for license. */
+#if !defined(BITMAP_HEADER_)
+#define BITMAP_HEADER_
+
+#include "compat.h"
+
+/* Bit sets over 64-bit positions, packed into 64-bit words.  Word
+   operations are inline; allocation and the whole-map operations,
+   which run across a parallel region, are in bitmap.c. */
+
+typedef struct {
+  uint64_t *start;
+  uint64_t *end;
+} bitmap_t;
+
+#define WORD_OFFSET(n) ((n) >> 6)
+#define BIT_OFFSET(n) ((n) & 0x3f)
+#define BM_BIT(n) ((uint64_t)1 << BIT_OFFSET(n))
+
+/** Allocate room for nbit bits without touching it, so the caller
+    may place pages by first touch.  Maps of a huge page or more are
+    aligned to one.  Returns 0 on success. */
+int bm_alloc (bitmap_t *bm, int64_t nbit);
+
+/** Allocate and clear. */
+int bm_init (bitmap_t *bm, int64_t nbit);
+
+void bm_free (bitmap_t *bm);
+
+/* The following are called by every thread of a parallel region, or
+   sequentially, and end with a barrier. */
+
+/** Clear all bits. */
+void bm_reset (bitmap_t *bm);
+
+/** Return the number of set bits. */
+int64_t bm_count (const bitmap_t *bm);
+
+/** Write the positions of the set bits to queue in increasing order
+    and return their number.  Each thread counts its share of the
+    words, and a prefix sum over the counts places its output. */
+int64_t bm_to_queue (const bitmap_t *bm, int64_t *queue);
+int64_t bm_to_queue_i32 (const bitmap_t *bm, int32_t *queue);
+
+/** Index of the lowest set bit of a nonzero word. */
+static inline int
+bm_word_ctz (uint64_t w)
+{
+#if defined(__GNUC__)
+  return __builtin_ctzll (w);
+#else
+  int k = 0;
+  while (!(w & 1)) {
+    w >>= 1;
+    k++;
+  }
+  return k;
+#endif
+}
+
+static inline int
+bm_word_popcount (uint64_t w)
+{
+#if defined(__GNUC__)
+  return __builtin_popcountll (w);
+#else
+  int k = 0;
+  for (; w; w &= w - 1)
+    k++;
+  return k;
+#endif
+}
+
+/** Atomically OR bits into *p and return the previous word. */
+static inline uint64_t
+bm_fetch_or (uint64_t *p, uint64_t bits)
+{
+#if defined(__GNUC__)||defined(__INTEL_COMPILER)
+  return __sync_fetch_and_or (p, bits);
+#elif defined(__MTA__)
+  uint64_t w = readfe (p);
+  writeef (p, w | bits);
+  return w;
+#else
+  uint64_t w;
+  OMP("omp critical (bm_fetch_or)") {
+    w = *p;
+    *p = w | bits;
+  }
+  return w;
+#endif
+}
+
+static inline uint64_t
+bm_get_bit (const bitmap_t *bm, int64_t pos)
+{
+  return bm->start[WORD_OFFSET(pos)] & BM_BIT(pos);
+}
+
+static inline void
+bm_set_bit (bitmap_t *bm, int64_t pos)
+{
+  bm->start[WORD_OFFSET(pos)] |= BM_BIT(pos);
+}
+
+/** Set a bit atomically; return nonzero if it was already set. */
+static inline uint64_t
+bm_set_bit_atomic (bitmap_t *bm, int64_t pos)
+{
+  uint64_t *p = &bm->start[WORD_OFFSET(pos)];
+  if (*p & BM_BIT(pos)) return 1;
+  return bm_fetch_or (p, BM_BIT(pos)) & BM_BIT(pos);
+}
+
+/** Return the first set position after pos, or -1. */
+static inline int64_t
+bm_get_next_bit (const bitmap_t *bm, int64_t pos)
+{
+  const uint64_t *it = bm->start + WORD_OFFSET(pos);
+  uint64_t w = (BIT_OFFSET(pos) == 63? 0 : *it & (~(uint64_t)0 << (BIT_OFFSET(pos) + 1)));
+  while (!w) {
+    if (++it >= bm->end) return -1;
+    w = *it;
+  }
+  return 64 * (int64_t)(it - bm->start) + bm_word_ctz (w);
+}
+
+static inline void
+bm_swap (bitmap_t *a, bitmap_t *b)
+{
+  bitmap_t t = *a;
+  *a = *b;
+  *b = t;
+}
+
+#endif /* BITMAP_HEADER_ */
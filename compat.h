@@ -35,11 +35,14 @@ typedef unsigned uint32_fast_t;
 #if defined(__GNUC__)
 static int omp_get_thread_num (void) __attribute__((unused));
 static int omp_get_num_threads (void) __attribute__((unused));
+static int omp_get_max_threads (void) __attribute__((unused));
 int omp_get_thread_num (void) { return 0; }
 int omp_get_num_threads (void) { return 1; }
+int omp_get_max_threads (void) { return 1; }
 #else
 static int omp_get_thread_num (void) { return 0; }
 static int omp_get_num_threads (void) { return 1; }
+static int omp_get_max_threads (void) { return 1; }
 #endif
 #endif
 
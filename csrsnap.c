@@ -0,0 +1,242 @@
+/* -*- mode: C; mode: folding; fill-column: 70; -*- */
+/* See COPYING for license. */
+#include "compat.h"
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+
+#include "options.h"
+#include "prng.h"
+#include "csrsnap.h"
+
+/* File layout: the header, then the offsets and the adjacency array,
+   each starting on a SNAP_ALIGN boundary.  Bump SNAP_VERSION whenever
+   the layout or the meaning of the arrays changes. */
+#define SNAP_MAGIC "G500CSR"
+#define SNAP_VERSION 1
+#define SNAP_ALIGN 4096
+
+struct snap_header {
+  char magic[8];
+  uint32_t version, vid_bytes;
+  int64_t scale, edgefactor, rmat;
+  uint64_t seed;
+  double a, b, c;
+  int64_t nedge, nv, nadj;
+  int64_t off_pos, adj_pos;
+  uint64_t checksum;
+};
+
+static int64_t
+align_up (int64_t x)
+{
+  return (x + SNAP_ALIGN - 1) & ~(int64_t)(SNAP_ALIGN - 1);
+}
+
+static void
+fill_header (struct snap_header *h, int64_t nedge, int vid_bytes)
+{
+  memset (h, 0, sizeof (*h));
+  memcpy (h->magic, SNAP_MAGIC, sizeof (SNAP_MAGIC));
+  h->version = SNAP_VERSION;
+  h->vid_bytes = vid_bytes;
+  h->scale = SCALE;
+  h->edgefactor = edgefactor;
+  h->rmat = use_RMAT;
+  h->seed = userseed;
+  h->a = A;
+  h->b = B;
+  h->c = C;
+  h->nedge = nedge;
+}
+
+/* splitmix64's finalizer. */
+static inline uint64_t
+mix (uint64_t x)
+{
+  x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ULL;
+  x = (x ^ (x >> 27)) * 0x94d049bb133111ebULL;
+  return x ^ (x >> 31);
+}
+
+/* Order-dependent sum over the bytes of p, padded with zeros to whole
+   words, so threads can reduce it in any order. */
+static uint64_t
+checksum (const void *p, int64_t nbytes, uint64_t salt)
+{
+  const unsigned char *b = p;
+  const int64_t nw = nbytes / 8;
+  uint64_t sum = 0, w = 0;
+  int64_t k;
+
+  OMP("omp parallel for reduction(+ : sum)")
+    for (k = 0; k < nw; ++k) {
+      uint64_t x;
+      memcpy (&x, b + 8*k, sizeof (x));
+      sum += mix (x ^ (salt + (uint64_t)k * 0x9e3779b97f4a7c15ULL));
+    }
+  if (nbytes % 8) {
+    memcpy (&w, b + 8*nw, nbytes % 8);
+    sum += mix (w ^ (salt + (uint64_t)nw * 0x9e3779b97f4a7c15ULL));
+  }
+  return sum;
+}
+
+static uint64_t
+graph_checksum (int64_t nv, const int64_t *off, const void *adj,
+		int64_t nadj, int vid_bytes)
+{
+  return checksum (off, (nv+1) * (int64_t)sizeof (*off), 1)
+    + checksum (adj, nadj * vid_bytes, 2);
+}
+
+int
+csr_snapshot_map (const char *path, int64_t nedge, int vid_bytes,
+		  struct csr_snapshot *snap)
+{
+  struct snap_header h, want;
+  struct stat st;
+  const char *why = NULL;
+  void *base;
+  int fd;
+
+  memset (snap, 0, sizeof (*snap));
+  if (dumpname) return -1;
+  if ((fd = open (path, O_RDONLY)) < 0) {
+    if (errno != ENOENT)
+      perror ("Cannot open the CSR snapshot");
+    return -1;
+  }
+  fill_header (&want, nedge, vid_bytes);
+  if (read (fd, &h, sizeof (h)) != sizeof (h) || fstat (fd, &st))
+    why = "cannot read the header";
+  else if (memcmp (h.magic, want.magic, sizeof (h.magic)))
+    why = "not a snapshot";
+  else if (h.version != SNAP_VERSION)
+    why = "other format version";
+  else if (h.vid_bytes != want.vid_bytes)
+    why = "other vertex ID width";
+  else if (h.scale != want.scale || h.edgefactor != want.edgefactor
+	   || h.rmat != want.rmat || h.seed != want.seed
+	   || h.a != want.a || h.b != want.b || h.c != want.c
+	   || h.nedge != want.nedge)
+    why = "other generator parameters";
+  else if (h.nv < 1 || h.nadj < 0 || h.off_pos < (int64_t)sizeof (h)
+	   || h.adj_pos < h.off_pos + (h.nv+1) * (int64_t)sizeof (int64_t)
+	   || st.st_size < h.adj_pos + h.nadj * vid_bytes)
+    why = "truncated";
+  if (why) {
+    fprintf (stderr, "Ignoring CSR snapshot %s: %s.\n", path, why);
+    close (fd);
+    return -1;
+  }
+
+  base = mmap (NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+  close (fd);
+  if (base == MAP_FAILED) {
+    perror ("Cannot map the CSR snapshot");
+    return -1;
+  }
+  snap->base = base;
+  snap->len = st.st_size;
+  snap->nv = h.nv;
+  snap->nadj = h.nadj;
+  snap->off = (const int64_t*)((const char*)base + h.off_pos);
+  snap->adj = (const char*)base + h.adj_pos;
+  if (graph_checksum (h.nv, snap->off, snap->adj, h.nadj, vid_bytes)
+      != h.checksum) {
+    fprintf (stderr, "Ignoring CSR snapshot %s: checksum mismatch.\n", path);
+    csr_snapshot_unmap (snap);
+    return -1;
+  }
+  return 0;
+}
+
+static int
+write_at (int fd, int64_t pos, const void *p, int64_t n)
+{
+  const char *b = p;
+  while (n > 0) {
+    const size_t len = (n > ((int64_t)1<<30)? (size_t)1<<30 : (size_t)n);
+    const ssize_t w = pwrite (fd, b, len, pos);
+    if (w <= 0) return -1;
+    b += w;
+    pos += w;
+    n -= w;
+  }
+  return 0;
+}
+
+/* Whether path holds a snapshot for the other vertex ID width, which
+   the other build would rebuild and rewrite in turn. */
+static int
+other_width (const char *path, int vid_bytes)
+{
+  struct snap_header h;
+  int fd, other = 0;
+
+  if ((fd = open (path, O_RDONLY)) < 0) return 0;
+  if (read (fd, &h, sizeof (h)) == sizeof (h)
+      && !memcmp (h.magic, SNAP_MAGIC, sizeof (SNAP_MAGIC))
+      && h.version == SNAP_VERSION && h.vid_bytes != (uint32_t)vid_bytes)
+    other = 1;
+  close (fd);
+  return other;
+}
+
+int
+csr_snapshot_write (const char *path, int64_t nedge, int vid_bytes,
+		    int64_t nv, const int64_t *off, const void *adj)
+{
+  struct snap_header h;
+  char *tmp;
+  int fd, err;
+
+  if (dumpname) return -1;
+  if (other_width (path, vid_bytes)) {
+    fprintf (stderr, "Keeping CSR snapshot %s for the other vertex ID width.\n",
+	     path);
+    return -1;
+  }
+  fill_header (&h, nedge, vid_bytes);
+  h.nv = nv;
+  h.nadj = off[nv];
+  h.off_pos = align_up (sizeof (h));
+  h.adj_pos = align_up (h.off_pos + (nv+1) * (int64_t)sizeof (*off));
+  h.checksum = graph_checksum (nv, off, adj, h.nadj, vid_bytes);
+
+  if (!(tmp = malloc (strlen (path) + 5))) return -1;
+  strcpy (tmp, path);
+  strcat (tmp, ".tmp");
+  if ((fd = open (tmp, O_WRONLY | O_CREAT | O_TRUNC, 0644)) < 0) {
+    perror ("Cannot create the CSR snapshot");
+    free (tmp);
+    return -1;
+  }
+  err = (write_at (fd, 0, &h, sizeof (h))
+	 || write_at (fd, h.off_pos, off, (nv+1) * (int64_t)sizeof (*off))
+	 || write_at (fd, h.adj_pos, adj, h.nadj * vid_bytes)
+	 || ftruncate (fd, h.adj_pos + h.nadj * vid_bytes));
+  if (close (fd)) err = 1;
+  if (!err && rename (tmp, path)) err = 1;
+  if (err) {
+    perror ("Cannot write the CSR snapshot");
+    unlink (tmp);
+  }
+  free (tmp);
+  return err? -1 : 0;
+}
+
+void
+csr_snapshot_unmap (struct csr_snapshot *snap)
+{
+  if (snap->base)
+    munmap (snap->base, snap->len);
+  memset (snap, 0, sizeof (*snap));
+}
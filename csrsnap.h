@@ -0,0 +1,40 @@
+/* -*- mode: C; mode: folding; fill-column: 70; -*- */
+/* See COPYING for license. */
+#if !defined(CSRSNAP_HEADER_)
+#define CSRSNAP_HEADER_
+
+#include "compat.h"
+
+/* CSR snapshots, enabled by CSR_SNAPSHOT=<file>.  A snapshot holds a
+   built graph in the compact layout: nv+1 offsets and the adjacency
+   entries, vid_bytes wide, with a header recording the generator
+   parameters, the input edge count and a checksum of the arrays.  A
+   matching snapshot is mapped read-only and shared, so the kernels
+   use the page cache's copy in place and several processes share it.
+   Snapshots from edge lists read with -o are never used. */
+
+struct csr_snapshot {
+  void *base;
+  size_t len;
+  int64_t nv, nadj;
+  const int64_t *off; /* Length nv+1 */
+  const void *adj;    /* Length nadj */
+};
+
+/** Map path if it holds the graph built from the current generator
+    parameters and nedge input edges with vid_bytes-wide entries and
+    its checksum holds.  Returns 0 on success; on failure snap->base
+    is NULL and, unless the file is absent, the reason is printed. */
+int csr_snapshot_map (const char *path, int64_t nedge, int vid_bytes,
+		      struct csr_snapshot *snap);
+
+/** Write the graph (off, adj) to path, through a temporary file
+    renamed into place.  A snapshot there for another vid_bytes is
+    kept instead, so builds of both widths can share a path without
+    rewriting it on every run.  Returns 0 on success. */
+int csr_snapshot_write (const char *path, int64_t nedge, int vid_bytes,
+			int64_t nv, const int64_t *off, const void *adj);
+
+void csr_snapshot_unmap (struct csr_snapshot *snap);
+
+#endif /* CSRSNAP_HEADER_ */
@@ -6,6 +6,7 @@
 #include <stdlib.h>
 #include <errno.h>
 #include <string.h>
+#include <stdarg.h>
 #include <math.h>
 
 #include <assert.h>
@@ -27,6 +28,7 @@
 #include "timer.h"
 #include "xalloc.h"
 #include "options.h"
+#include "bfstrace.h"
 #include "generator/splittable_mrg.h"
 #include "generator/graph_generator.h"
 #include "generator/make_graph.h"
@@ -43,7 +45,14 @@ static int64_t bfs_nedge[NBFS_max];
 static packed_edge * restrict IJ;
 static int64_t nedge;
 
+#define NREPORT_max 256
+#define REPORT_LEN 128
+static int nreport;
+static char report_line[NREPORT_max][REPORT_LEN];
+
 static void run_bfs (void);
+static void run_bfs_batched (int batch);
+static void check_bfs (int m, int64_t *bfs_tree, int64_t max_bfsvtx);
 static void output_results (const int64_t SCALE, int64_t nvtx_scale,
 			    int64_t edgefactor,
 			    const double A, const double B,
@@ -64,6 +73,7 @@ main (int argc, char **argv)
 
   if (argc > 1)
     get_options (argc, argv);
+  bfs_trace_init ();
 
   nvtx_scale = ((int64_t)1)<<SCALE;
 
@@ -117,6 +127,7 @@ main (int argc, char **argv)
 void
 run_bfs (void)
 {
+  struct bfs_workspace *ws;
   int * restrict has_adj;
   int m, err;
   int64_t k, t, nvtx_connected = 0;
@@ -190,37 +201,159 @@ run_bfs (void)
     close (fd);
   }
 
+  m = (getenv ("BFS_BATCH")? atoi (getenv ("BFS_BATCH")) : 0);
+  if (m > 1) {
+    run_bfs_batched (m < 64? m : 64);
+    destroy_graph ();
+    return;
+  }
+
+  ws = create_bfs_workspace ();
+  if (!ws) {
+    perror ("create_bfs_workspace failed");
+    abort ();
+  }
+
   for (m = 0; m < NBFS; ++m) {
     int64_t *bfs_tree, max_bfsvtx;
 
-    /* Re-allocate. Some systems may randomize the addres... */
-    bfs_tree = xmalloc_large (nvtx_scale * sizeof (*bfs_tree));
     assert (bfs_root[m] < nvtx_scale);
 
     if (VERBOSE) fprintf (stderr, "Running bfs %d...", m);
-    TIME(bfs_time[m], err = make_bfs_tree (bfs_tree, &max_bfsvtx, bfs_root[m]));
+    bfs_trace_begin (bfs_root[m]);
+    TIME(bfs_time[m], err = run_bfs_workspace (ws, bfs_root[m],
+					       &bfs_tree, &max_bfsvtx));
     if (VERBOSE) fprintf (stderr, "done\n");
 
     if (err) {
-      perror ("make_bfs_tree failed");
+      perror ("run_bfs_workspace failed");
       abort ();
     }
 
-    if (!getenv("SKIP_VALIDATION")) {
-      if (VERBOSE) fprintf (stderr, "Verifying bfs %d...", m);
-      bfs_nedge[m] = verify_bfs_tree (bfs_tree, max_bfsvtx, bfs_root[m], IJ, nedge);
-      if (VERBOSE) fprintf (stderr, "done\n");
-      if (bfs_nedge[m] < 0) {
-	fprintf (stderr, "bfs %d from %" PRId64 " failed verification (%" PRId64 ")\n",
-		 m, bfs_root[m], bfs_nedge[m]);
-	abort ();
-      }
+    check_bfs (m, bfs_tree, max_bfsvtx);
+    bfs_trace_end (bfs_time[m], getenv("SKIP_VALIDATION")? -1 : bfs_nedge[m]);
+  }
+
+  destroy_bfs_workspace (ws);
+  destroy_graph ();
+}
+
+/* Search the roots batch at a time with make_bfs_trees.  Each root is
+   charged an equal share of its batch's time, so the TEPS statistics
+   measure the amortized rate. */
+void
+run_bfs_batched (int batch)
+{
+  int64_t *bfs_tree[64], max_bfsvtx;
+  int m, k, n, err;
+  double t;
+
+  for (m = 0; m < NBFS; m += batch) {
+    n = (NBFS - m < batch? NBFS - m : batch);
+    for (k = 0; k < n; ++k) {
+      bfs_tree[k] = xmalloc_large (nvtx_scale * sizeof (*bfs_tree[k]));
+      assert (bfs_root[m+k] < nvtx_scale);
+    }
+
+    if (VERBOSE) fprintf (stderr, "Running bfs %d-%d...", m, m+n-1);
+    TIME(t, err = make_bfs_trees (bfs_tree, &max_bfsvtx, &bfs_root[m], n));
+    if (VERBOSE) fprintf (stderr, "done\n");
+
+    if (err) {
+      perror ("make_bfs_trees failed");
+      abort ();
     }
 
-    xfree_large (bfs_tree);
+    for (k = 0; k < n; ++k) {
+      bfs_time[m+k] = t / n;
+      check_bfs (m+k, bfs_tree[k], max_bfsvtx);
+      xfree_large (bfs_tree[k]);
+    }
   }
+  report_result ("bfs_batch: %d", batch);
+}
 
-  destroy_graph ();
+void
+check_bfs (int m, int64_t *bfs_tree, int64_t max_bfsvtx)
+{
+  if (getenv("SKIP_VALIDATION")) return;
+  if (VERBOSE) fprintf (stderr, "Verifying bfs %d...", m);
+  bfs_nedge[m] = verify_bfs_tree (bfs_tree, max_bfsvtx, bfs_root[m], IJ, nedge);
+  if (VERBOSE) fprintf (stderr, "done\n");
+  if (bfs_nedge[m] < 0) {
+    fprintf (stderr, "bfs %d from %" PRId64 " failed verification (%" PRId64 ")\n",
+	     m, bfs_root[m], bfs_nedge[m]);
+    abort ();
+  }
+}
+
+#if defined(__GNUC__)
+__attribute__((weak))
+#endif
+int
+make_bfs_trees (int64_t **bfs_tree_out, int64_t *max_vtx_out,
+		const int64_t *srcvtx, int nroot)
+{
+  int k, err;
+  for (k = 0; k < nroot; ++k)
+    if ((err = make_bfs_tree (bfs_tree_out[k], max_vtx_out, srcvtx[k])))
+      return err;
+  return 0;
+}
+
+/* The default workspace only keeps the tree between roots. */
+struct bfs_workspace {
+  int64_t *tree;
+};
+
+#if defined(__GNUC__)
+__attribute__((weak))
+#endif
+struct bfs_workspace *
+create_bfs_workspace (void)
+{
+  struct bfs_workspace *ws = malloc (sizeof (*ws));
+  if (!ws) return NULL;
+  if (!(ws->tree = xmalloc_large (nvtx_scale * sizeof (*ws->tree)))) {
+    free (ws);
+    return NULL;
+  }
+  return ws;
+}
+
+#if defined(__GNUC__)
+__attribute__((weak))
+#endif
+int
+run_bfs_workspace (struct bfs_workspace *ws, int64_t srcvtx,
+		   int64_t **bfs_tree_out, int64_t *max_vtx_out)
+{
+  *bfs_tree_out = ws->tree;
+  return make_bfs_tree (ws->tree, max_vtx_out, srcvtx);
+}
+
+#if defined(__GNUC__)
+__attribute__((weak))
+#endif
+void
+destroy_bfs_workspace (struct bfs_workspace *ws)
+{
+  xfree_large (ws->tree);
+  free (ws);
+}
+
+void
+report_result (const char *fmt, ...)
+{
+  va_list ap;
+
+  if (nreport >= NREPORT_max) {
+    fprintf (stderr, "Too many reported results, dropping \"%s\".\n", fmt);
+    return;
+  }
+  va_start (ap, fmt);
+  vsnprintf (report_line[nreport++], REPORT_LEN, fmt, ap);
+  va_end (ap);
 }
 
 #define NSTAT 9
@@ -359,4 +492,8 @@ output_results (const int64_t SCALE, int64_t nvtx_scale, int64_t edgefactor,
     tm[k] = bfs_nedge[k] / bfs_time[k];
   statistics (stats, tm, NBFS);
   PRINT_STATS("TEPS", 1);
+
+  bfs_trace_write ();
+  for (k = 0; k < nreport; ++k)
+    printf ("%s\n", report_line[k]);
 }
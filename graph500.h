@@ -16,7 +16,33 @@ int create_graph_from_edgelist (struct packed_edge *IJ, int64_t nedge);
 int make_bfs_tree (int64_t *bfs_tree_out, int64_t *max_vtx_out,
 		   int64_t srcvtx);
 
+/** Create the BFS trees from nroot <= 64 source vertices at once,
+    into bfs_tree_out[0..nroot).  Implementations that do not provide
+    it get a default that calls make_bfs_tree per root. */
+int make_bfs_trees (int64_t **bfs_tree_out, int64_t *max_vtx_out,
+		    const int64_t *srcvtx, int nroot);
+
+/** A search workspace: the BFS tree and every scratch buffer a
+    search needs, allocated once and reused across roots.
+    Implementations that do not provide one get a default that keeps
+    only the tree and calls make_bfs_tree. */
+struct bfs_workspace;
+
+/** Allocate a workspace for the current graph, or return NULL. */
+struct bfs_workspace *create_bfs_workspace (void);
+
+/** Search from srcvtx.  *bfs_tree_out points into the workspace and
+    stays valid until its next search or destruction. */
+int run_bfs_workspace (struct bfs_workspace *ws, int64_t srcvtx,
+		       int64_t **bfs_tree_out, int64_t *max_vtx_out);
+
+void destroy_bfs_workspace (struct bfs_workspace *ws);
+
 /** Clean up. */
 void destroy_graph (void);
 
+/** Record an implementation-specific "key: value" output line,
+    printed after the standard results. */
+void report_result (const char *fmt, ...);
+
 #endif /* GRAPH500_HEADER_ */
@@ -0,0 +1,61 @@
+/* -*- mode: C; mode: folding; fill-column: 70; -*- */
+/* See COPYING for license. */
+#include "compat.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "isa.h"
+
+static const char *names[ISA_NLEVEL] = { "scalar", "avx2", "avx512" };
+static int level = -1;
+
+static int
+detect (void)
+{
+#if defined(HAVE_ISA_X86)
+  __builtin_cpu_init ();
+  if (__builtin_cpu_supports ("avx512f"))
+    return ISA_AVX512;
+  if (__builtin_cpu_supports ("avx2"))
+    return ISA_AVX2;
+#endif
+  return ISA_SCALAR;
+}
+
+int
+isa_level (void)
+{
+  if (level < 0) {
+    const char *want = getenv ("ISA");
+    int k, best = detect ();
+    level = best;
+    if (want) {
+      for (k = 0; k < ISA_NLEVEL; ++k)
+	if (!strcmp (want, names[k])) break;
+      if (k == ISA_NLEVEL)
+	fprintf (stderr, "Unknown ISA %s, using %s.\n", want, names[best]);
+      else if (k > best)
+	fprintf (stderr, "ISA %s not supported, using %s.\n", want, names[best]);
+      else
+	level = k;
+    }
+  }
+  return level;
+}
+
+const char *
+isa_name (int lvl)
+{
+  return (lvl >= 0 && lvl < ISA_NLEVEL? names[lvl] : "unknown");
+}
+
+isa_fn
+isa_select (const isa_fn *impl, int *chosen)
+{
+  int k;
+  for (k = isa_level (); k > ISA_SCALAR; --k)
+    if (impl[k]) break;
+  if (chosen) *chosen = k;
+  return impl[k];
+}
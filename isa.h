@@ -0,0 +1,40 @@
+/* -*- mode: C; mode: folding; fill-column: 70; -*- */
+/* See COPYING for license. */
+#if !defined(ISA_HEADER_)
+#define ISA_HEADER_
+
+/* Runtime instruction-set dispatch.  Hot loops provide one variant
+   per level, compiled with target attributes so that a single binary
+   carries all of them, and pick one with isa_select. */
+
+#if defined(__GNUC__) && !defined(__INTEL_COMPILER) && defined(__x86_64__)
+#define HAVE_ISA_X86 1
+#define ISA_TARGET(t) __attribute__((target(t)))
+#else
+#define ISA_TARGET(t)
+#endif
+
+/* For generic loop bodies that each variant instantiates. */
+#if defined(__GNUC__)
+#define ISA_INLINE static inline __attribute__((always_inline))
+#else
+#define ISA_INLINE static inline
+#endif
+
+enum { ISA_SCALAR = 0, ISA_AVX2, ISA_AVX512, ISA_NLEVEL };
+
+typedef void (*isa_fn) (void);
+
+/** Highest level this CPU and OS support, lowered by the ISA
+    environment variable (scalar, avx2 or avx512) if set. */
+int isa_level (void);
+
+/** Name of a level, as accepted by the ISA variable. */
+const char *isa_name (int level);
+
+/** Return the entry of impl (ISA_NLEVEL long, impl[ISA_SCALAR]
+    non-NULL) for the highest available level that is non-NULL, and
+    store that level in *chosen unless chosen is NULL. */
+isa_fn isa_select (const isa_fn *impl, int *chosen);
+
+#endif /* ISA_HEADER_ */
@@ -18,6 +18,8 @@ static int int64_cas(int64_t* p, int64_t oldval, int64_t newval);
 #include "../graph500.h"
 #include "../xalloc.h"
 #include "../generator/graph_generator.h"
+#include "../timer.h"
+#include "../bfstrace.h"
 
 #define MINVECT_SIZE 2
 
@@ -232,6 +234,41 @@ create_graph_from_edgelist (struct packed_edge *IJ, int64_t nedge)
   return 0;
 }
 
+/* Edge-balanced levels.  vsum holds the exclusive prefix sum of the
+   frontier's degrees, and the level's edges are cut into about
+   TD_PIECES ranges per thread, split at any list position and claimed
+   dynamically, so one hub no longer holds up the whole team. */
+#define TD_PIECES 8
+#define TD_MIN_PIECE 256
+
+static int64_t
+frontier_scan (const int64_t * restrict vlist, int64_t k1, int64_t k2,
+	       int64_t * restrict vsum, int64_t *buf)
+{
+  const int nt = omp_get_num_threads (), tid = omp_get_thread_num ();
+  const int64_t n = k2 - k1;
+  const int64_t kb = n * tid / nt, ke = n * (tid+1) / nt;
+  int64_t k, acc = 0;
+
+  for (k = kb; k < ke; ++k) {
+    const int64_t v = vlist[k1 + k];
+    vsum[k] = acc;
+    acc += XENDOFF(v) - XOFF(v);
+  }
+  buf[tid+1] = acc;
+  OMP("omp barrier");
+  OMP("omp single") {
+    buf[0] = 0;
+    for (k = 0; k < nt; ++k)
+      buf[k+1] += buf[k];
+    vsum[n] = buf[nt];
+  }
+  for (k = kb; k < ke; ++k)
+    vsum[k] += buf[tid];
+  OMP("omp barrier");
+  return vsum[n];
+}
+
 int
 make_bfs_tree (int64_t *bfs_tree_out, int64_t *max_vtx_out,
 	       int64_t srcvtx)
@@ -240,12 +277,23 @@ make_bfs_tree (int64_t *bfs_tree_out, int64_t *max_vtx_out,
   int err = 0;
 
   int64_t * restrict vlist = NULL;
+  int64_t * restrict vsum = NULL;
+  int64_t *buf, *work;
+  double *busy;
   int64_t k1, k2;
 
   *max_vtx_out = maxvtx;
 
   vlist = xmalloc_large (nv * sizeof (*vlist));
   if (!vlist) return -1;
+  vsum = xmalloc_large ((nv+1) * sizeof (*vsum));
+  if (!vsum) {
+    xfree_large (vlist);
+    return -1;
+  }
+  buf = alloca ((omp_get_max_threads () + 1) * sizeof (*buf));
+  busy = alloca (omp_get_max_threads () * sizeof (*busy));
+  work = alloca (omp_get_max_threads () * sizeof (*work));
 
   vlist[0] = srcvtx;
   k1 = 0; k2 = 1;
@@ -265,26 +313,45 @@ make_bfs_tree (int64_t *bfs_tree_out, int64_t *max_vtx_out,
 
     while (k1 != k2) {
       const int64_t oldk2 = k2;
-      int64_t kbuf = 0;
+      const int64_t n = oldk2 - k1;
+      int64_t kbuf = 0, nedge, piece, npiece, r, checked = 0;
+      double t0;
       OMP("omp barrier");
-      OMP("omp for")
-	for (k = k1; k < oldk2; ++k) {
-	  const int64_t v = vlist[k];
-	  const int64_t veo = XENDOFF(v);
-	  int64_t vo;
-	  for (vo = XOFF(v); vo < veo; ++vo) {
-	    const int64_t j = xadj[vo];
-	    if (bfs_tree[j] == -1) {
-	      if (int64_cas (&bfs_tree[j], -1, v)) {
-		if (kbuf < THREAD_BUF_LEN) {
-		  nbuf[kbuf++] = j;
-		} else {
-		  int64_t voff = int64_fetch_add (&k2, THREAD_BUF_LEN), vk;
-		  assert (voff + THREAD_BUF_LEN <= nv);
-		  for (vk = 0; vk < THREAD_BUF_LEN; ++vk)
-		    vlist[voff + vk] = nbuf[vk];
-		  nbuf[0] = j;
-		  kbuf = 1;
+      t0 = (bfs_trace_on? timestamp () : 0);
+      nedge = frontier_scan (vlist, k1, oldk2, vsum, buf);
+      piece = nedge / (TD_PIECES * omp_get_num_threads ()) + 1;
+      if (piece < TD_MIN_PIECE) piece = TD_MIN_PIECE;
+      npiece = (nedge + piece - 1) / piece;
+      OMP("omp for schedule(dynamic)")
+	for (r = 0; r < npiece; ++r) {
+	  const int64_t e0 = r * piece;
+	  const int64_t e1 = (e0 + piece < nedge? e0 + piece : nedge);
+	  int64_t lo = 0, hi = n - 1;
+	  while (lo < hi) {
+	    const int64_t mid = (lo + hi + 1) / 2;
+	    if (vsum[mid] <= e0) lo = mid;
+	    else hi = mid - 1;
+	  }
+	  for (k = lo; k < n && vsum[k] < e1; ++k) {
+	    const int64_t v = vlist[k1 + k];
+	    const int64_t vb = XOFF(v) + (e0 > vsum[k]? e0 - vsum[k] : 0);
+	    const int64_t ve = (e1 < vsum[k+1]? XOFF(v) + e1 - vsum[k] : XENDOFF(v));
+	    int64_t vo;
+	    checked += ve - vb;
+	    for (vo = vb; vo < ve; ++vo) {
+	      const int64_t j = xadj[vo];
+	      if (bfs_tree[j] == -1) {
+		if (int64_cas (&bfs_tree[j], -1, v)) {
+		  if (kbuf < THREAD_BUF_LEN) {
+		    nbuf[kbuf++] = j;
+		  } else {
+		    int64_t voff = int64_fetch_add (&k2, THREAD_BUF_LEN), vk;
+		    assert (voff + THREAD_BUF_LEN <= nv);
+		    for (vk = 0; vk < THREAD_BUF_LEN; ++vk)
+		      vlist[voff + vk] = nbuf[vk];
+		    nbuf[0] = j;
+		    kbuf = 1;
+		  }
 		}
 	      }
 	    }
@@ -296,12 +363,27 @@ make_bfs_tree (int64_t *bfs_tree_out, int64_t *max_vtx_out,
 	for (vk = 0; vk < kbuf; ++vk)
 	  vlist[voff + vk] = nbuf[vk];
       }
-      OMP("omp single")
-	k1 = oldk2;
+      if (bfs_trace_on) {
+	busy[omp_get_thread_num ()] = timestamp () - t0;
+	work[omp_get_thread_num ()] = checked;
+      }
       OMP("omp barrier");
+      OMP("omp single") {
+	if (bfs_trace_on) {
+	  struct bfs_trace_level lvl;
+	  lvl.dir = BFS_TRACE_TOP_DOWN;
+	  lvl.frontier = n;
+	  lvl.scout = lvl.checked = nedge;
+	  lvl.awake = k2 - oldk2;
+	  lvl.time = timestamp () - t0;
+	  bfs_trace_level (&lvl, busy, work, omp_get_num_threads ());
+	}
+	k1 = oldk2;
+      }
     }
   }
 
+  xfree_large (vsum);
   xfree_large (vlist);
 
   return err;
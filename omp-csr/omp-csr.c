@@ -11,27 +11,111 @@
 #include <assert.h>
 
 #include <alloca.h>
+#include <unistd.h>
+#include <sched.h>
+
+#if defined(HAVE_LIBNUMA)
+#include <numa.h>
+#endif
 
 static int64_t int64_fetch_add (int64_t* p, int64_t incr);
 static int64_t int64_casval(int64_t* p, int64_t oldval, int64_t newval);
-static int int64_cas(int64_t* p, int64_t oldval, int64_t newval);
+static int64_t int64_fetch_or (int64_t* p, int64_t bits);
+static int compact_graph (int64_t *saved);
+static void select_kernels (void);
+static void setup_levels (void);
+static void setup_direction (void);
+static void setup_prefetch (void);
 
 #include "../graph500.h"
 #include "../xalloc.h"
 #include "../generator/graph_generator.h"
 #include "../timer.h"
+#include "../adjsort.h"
+#include "../isa.h"
+#include "../bfstrace.h"
 
-#include "bitmap.h"
+#include "../bitmap.h"
+#include "../csrsnap.h"
+#include "../prefetch.h"
+#include "../tune.h"
+
+#if defined(HAVE_ISA_X86)
+#include <immintrin.h>
+#endif
 
 #define MINVECT_SIZE 2
-#define THREAD_BUF_LEN 16384
 #define ALPHA 14
 #define BETA  24
+#define SERIAL_EDGES 1024
+
+/* Direction-switch thresholds: go bottom-up once the frontier's edges
+   exceed 1/alpha of the unexplored edges, and back top-down once fewer
+   than nv/beta vertices wake up.  See setup_direction. */
+static int64_t bfs_alpha = ALPHA, bfs_beta = BETA;
+
+/* Top-down levels whose frontier has fewer out-edges than this run on
+   one thread.  See setup_levels. */
+static int64_t bfs_serial_edges = SERIAL_EDGES;
+
+/* Top-down prefetch distances, see prefetch.h and setup_prefetch. */
+static struct prefetch_dist pf;
+
+/* Propagation-blocked top-down levels, see td_propagate. */
+static int td_blocking;
+
+/* Degree classes, see setup_classes.  Bottom-up steps probe lists of
+   at most VC_TINY neighbors with the scalar loop, skipping the vector
+   kernels' setup and masked gathers, and top-down steps split the
+   lists of hubs, vertices of at least VC_HUB neighbors, across
+   threads; the medium lists between take the vector scans and the
+   vertex grains.  vc_nhub counts the hubs. */
+#define VC_TINY 4
+#define VC_HUB 4096
+#define VC_HUB_PIECE 1024
+static int64_t vc_nhub;
+
+/* Vertex identifiers stored in the adjacency lists, the frontier
+   queue, and the BFS tree.  Building with -DUSE_VID32 halves the
+   memory traffic of the neighbor loops for graphs with fewer than
+   2^31 vertices.  Edge offsets remain 64-bit in either case. */
+#if defined(USE_VID32)
+typedef int32_t vid_t;
+#define VID_MAX INT32_MAX
+#define adjsort_pack_vid adjsort_pack_i32
+#define bm_to_queue_vid bm_to_queue_i32
+#else
+typedef int64_t vid_t;
+#define VID_MAX INT64_MAX
+#define adjsort_pack_vid adjsort_pack_i64
+#define bm_to_queue_vid bm_to_queue
+#endif
+
+static int64_t maxvtx, nv, sz, nedge_in;
+static int64_t * restrict xoff; /* Length nv+1 */
+static vid_t * restrict xadj; /* Length xoff[nv] */
+
+/* Construction layout, see compact_graph: interleaved begin and end
+   offsets, lists padded to MINVECT_SIZE and holes left by
+   deduplication. */
+static int64_t * restrict bxoff; /* Length 2*nv+2 */
+static vid_t * restrict xadjstore; /* Length MINVECT_SIZE + BXOFF(nv) */
+static vid_t * restrict bxadj;
+
+/* Compressed adjacency replacing xadj, see compress_graph. */
+static uint8_t * restrict cadj;
+static int64_t * restrict coff; /* Length nv+1 */
+
+/* Bottom-up segments, see setup_segments.  Segment s holds vertices
+   [s*bu_span, (s+1)*bu_span), and row s-1 of segpos gives each list's
+   position of its first neighbor in segment s or later. */
+static int64_t bu_nseg = 1, bu_span;
+static uint32_t * restrict segpos; /* Length (bu_nseg-1)*nv */
 
-static int64_t maxvtx, nv, sz;
-static int64_t * restrict xoff; /* Length 2*nv+2 */
-static int64_t * restrict xadjstore; /* Length MINVECT_SIZE + (xoff[nv] == nedge) */
-static int64_t * restrict xadj;
+/* Optional relabeling, see reorder_graph.  perm_new maps original
+   vertex IDs to internal ones and perm_old maps back. */
+static vid_t * restrict perm_new;
+static vid_t * restrict perm_old;
 
 static void
 find_nv (const struct packed_edge * restrict IJ, const int64_t nedge)
@@ -54,25 +138,189 @@ find_nv (const struct packed_edge * restrict IJ, const int64_t nedge)
   nv = 1+maxvtx;
 }
 
+#define XOFF(k) (xoff[(k)])
+#define XENDOFF(k) (xoff[(k)+1])
+#define BXOFF(k) (bxoff[2*(k)])
+#define BXENDOFF(k) (bxoff[1+2*(k)])
+
+/* NUMA partitioning.  With NUMA_NODES=n in the environment (n <= 0
+   asks libnuma for the node count), the vertex range is split into n
+   slices [part_lo[p], part_lo[p+1]) aligned to bitmap words.  Each
+   slice's offsets, adjacency, BFS tree entries and bitmap words live
+   on the slice's node, bound with libnuma when available and
+   otherwise placed by first touch from that node's threads.  Threads
+   belong to nodes in blocks of consecutive thread numbers, so without
+   libnuma run with OMP_PROC_BIND=close. */
+#define NUMA_MAX 32
+#define NUMA_PAD 8
+
+static int npart = 1;
+static int64_t part_lo[NUMA_MAX+1];
+static int64_t part_xoff[NUMA_MAX+1];
+static int64_t part_adj[NUMA_MAX+1];
+static int64_t part_cadj[NUMA_MAX+1];
+static int64_t part_word[NUMA_MAX+1];
+static int64_t part_next[NUMA_MAX*NUMA_PAD];
+
+static struct {
+  int64_t vertices, stolen, local_probes, remote_probes;
+  int64_t pad[NUMA_PAD-4];
+} numa_stats[NUMA_MAX];
+
+static int
+thread_node (void)
+{
+  return (int)(((int64_t)omp_get_thread_num ()) * npart / omp_get_num_threads ());
+}
+
+/* This thread's static share [*b, *e) of slice p of bound, empty
+   unless the thread belongs to node p.  A node without threads is
+   covered by the thread nearest to it. */
+static void
+numa_share (int p, const int64_t *bound, int64_t *b, int64_t *e)
+{
+  const int nt = omp_get_num_threads (), tid = omp_get_thread_num ();
+  int t0 = (int)(((int64_t)p * nt + npart - 1) / npart);
+  int t1 = (int)(((int64_t)(p+1) * nt + npart - 1) / npart);
+  int64_t n;
+
+  if (t0 == t1) {
+    t0 = (int)((int64_t)p * nt / npart);
+    t1 = t0 + 1;
+  }
+  if (tid < t0 || tid >= t1) {
+    *b = *e = 0;
+    return;
+  }
+  n = bound[p+1] - bound[p];
+  *b = bound[p] + n * (tid - t0) / (t1 - t0);
+  *e = bound[p] + n * (tid - t0 + 1) / (t1 - t0);
+}
+
+#if defined(HAVE_LIBNUMA)
+static int
+numa_node_of_part (int p)
+{
+  return (int)((int64_t)p * numa_num_configured_nodes () / npart);
+}
+#endif
+
+/* Bind the pages holding each slice of an array, elements of size
+   elsz split at bound[], to the slice's node.  Pages straddling two
+   slices go to the lower one.  A no-op without libnuma. */
+static void
+numa_place (void *base, size_t elsz, const int64_t *bound)
+{
+#if defined(HAVE_LIBNUMA)
+  const uintptr_t pg = sysconf (_SC_PAGESIZE);
+  int p;
+
+  if (npart == 1 || numa_available () < 0) return;
+  for (p = 0; p < npart; ++p) {
+    uintptr_t b = (uintptr_t)base + bound[p] * elsz;
+    uintptr_t e = (uintptr_t)base + bound[p+1] * elsz;
+    b = (p? (b + pg - 1) : b) & ~(pg - 1);
+    e = (e + pg - 1) & ~(pg - 1);
+    if (e > b)
+      numa_tonode_memory ((void*)b, e - b, numa_node_of_part (p));
+  }
+#endif
+}
+
+static void
+numa_setup (void)
+{
+  const char *s = getenv ("NUMA_NODES");
+  int p;
+
+  npart = 1;
+  if (s) {
+    npart = atoi (s);
+#if defined(HAVE_LIBNUMA)
+    if (npart <= 0 && numa_available () >= 0)
+      npart = numa_num_configured_nodes ();
+#endif
+    if (npart < 1) npart = 1;
+    if (npart > NUMA_MAX) npart = NUMA_MAX;
+  }
+  for (p = 0; p < npart; ++p) {
+    part_lo[p] = ((nv * p / npart) + 63) & ~(int64_t)63;
+    if (part_lo[p] > nv) part_lo[p] = nv;
+    part_xoff[p] = 2*part_lo[p];
+    part_word[p] = part_lo[p] / 64;
+  }
+  part_lo[npart] = nv;
+  part_xoff[npart] = 2*nv+2;
+  part_word[npart] = (nv + 63) / 64;
+  memset (numa_stats, 0, sizeof (numa_stats));
+
+#if defined(HAVE_LIBNUMA)
+  if (npart > 1 && numa_available () >= 0)
+    OMP("omp parallel")
+      numa_run_on_node (numa_node_of_part (thread_node ()));
+#endif
+}
+
+static void
+numa_report (void)
+{
+  int p;
+
+  if (npart == 1) return;
+  report_result ("numa_nodes: %d", npart);
+  for (p = 0; p < npart; ++p) {
+    report_result ("numa_node%d_vertices: %" PRId64, p, part_lo[p+1] - part_lo[p]);
+    report_result ("numa_node%d_adjacency_bytes: %" PRId64, p,
+		   (cadj? part_cadj[p+1] - part_cadj[p]
+		    : (int64_t)((part_adj[p+1] - part_adj[p]) * sizeof (*xadj))));
+    report_result ("numa_node%d_bu_vertices: %" PRId64, p, numa_stats[p].vertices);
+    report_result ("numa_node%d_bu_stolen_vertices: %" PRId64, p, numa_stats[p].stolen);
+    report_result ("numa_node%d_bu_local_probes: %" PRId64, p, numa_stats[p].local_probes);
+    report_result ("numa_node%d_bu_remote_probes: %" PRId64, p, numa_stats[p].remote_probes);
+  }
+}
+
 static int
 alloc_graph (int64_t nedge)
 {
-  sz = (2*nv+2) * sizeof (*xoff);
-  xoff = xmalloc_large_ext (sz);
-  if (!xoff) return -1;
+  bxoff = xmalloc_large_ext ((2*nv+2) * sizeof (*bxoff));
+  if (!bxoff) return -1;
+  numa_place (bxoff, sizeof (*bxoff), part_xoff);
   return 0;
 }
 
+/* Graph snapshots, see csrsnap.h.  While snap.base is set, xoff and
+   xadj (unless compress_graph dropped it) point into the read-only
+   mapping. */
+static struct csr_snapshot snap;
+
 static void
 free_graph (void)
 {
-  xfree_large (xadjstore);
-  xfree_large (xoff);
+  if (cadj) {
+    xfree_large (cadj);
+    xfree_large (coff);
+    cadj = NULL;
+    coff = NULL;
+  }
+  if (segpos) {
+    xfree_large (segpos);
+    segpos = NULL;
+    bu_nseg = 1;
+  }
+  if (snap.base)
+    csr_snapshot_unmap (&snap);
+  else {
+    if (xadj) xfree_large (xadj);
+    xfree_large (xoff);
+  }
+  if (perm_new) {
+    xfree_large (perm_old);
+    xfree_large (perm_new);
+    perm_new = perm_old = NULL;
+  }
 }
 
-#define XOFF(k) (xoff[2*(k)])
-#define XENDOFF(k) (xoff[1+2*(k)])
-
 static int64_t
 prefix_sum (int64_t *buf)
 {
@@ -89,7 +337,7 @@ prefix_sum (int64_t *buf)
 
   buf[tid] = 0;
   for (k = slice_begin; k < slice_end; ++k)
-    buf[tid] += XOFF(k);
+    buf[tid] += BXOFF(k);
   OMP("omp barrier");
   OMP("omp single")
     for (k = 1; k < nt; ++k)
@@ -99,339 +347,2792 @@ prefix_sum (int64_t *buf)
   else
     t1 = 0;
   for (k = slice_begin; k < slice_end; ++k) {
-    int64_t tmp = XOFF(k);
-    XOFF(k) = t1;
+    int64_t tmp = BXOFF(k);
+    BXOFF(k) = t1;
     t1 += tmp;
   }
-  OMP("omp flush (xoff)");
+  OMP("omp flush (bxoff)");
   OMP("omp barrier");
   return buf[nt-1];
 }
 
+/* Contention-free construction.  The edge list is consumed in rounds
+   of at most round_len edges.  Each round partitions its directed
+   edges by source block into round_edge, using per-thread block
+   counts and an exclusive scan, so every block is afterwards applied
+   by a single thread without atomics.  The rounds run twice: once to
+   count degrees and once to scatter the adjacency entries. */
+#define BLOCKS_PER_THREAD 16
+#define MIN_ROUND_LEN ((int64_t)1<<20)
+
+struct dir_edge { vid_t i, j; };
+
+static int blk_shift;
+static int64_t nblk, round_len;
+static int64_t * restrict round_cnt; /* Length nthreads*nblk */
+static int64_t * restrict round_blk; /* Length nblk+1 */
+static struct dir_edge * restrict round_edge; /* Length 2*round_len */
+
 static int
-setup_deg_off (const struct packed_edge * restrict IJ, int64_t nedge)
+alloc_rounds (int64_t nedge)
 {
-  int err = 0;
-  int64_t *buf = NULL;
-  xadj = NULL;
-  OMP("omp parallel") {
-    int64_t k, accum;
-    OMP("omp for")
-      for (k = 0; k < 2*nv+2; ++k)
-	xoff[k] = 0;
-    OMP("omp for")
-      for (k = 0; k < nedge; ++k) {
-	int64_t i = get_v0_from_edge(&IJ[k]);
-	int64_t j = get_v1_from_edge(&IJ[k]);
-	if (i != j) { /* Skip self-edges. */
-	  if (i >= 0)
-	    OMP("omp atomic")
-	      ++XOFF(i);
-	  if (j >= 0)
-	    OMP("omp atomic")
-	      ++XOFF(j);
-	}
-      }
-    OMP("omp single") {
-      buf = alloca (omp_get_num_threads () * sizeof (*buf));
-      if (!buf) {
-	perror ("alloca for prefix-sum hosed");
-	abort ();
-      }
-    }
-    OMP("omp for")
-      for (k = 0; k < nv; ++k)
-	if (XOFF(k) < MINVECT_SIZE) XOFF(k) = MINVECT_SIZE;
+  int nt = 1;
 
-    accum = prefix_sum (buf);
+  OMP("omp parallel")
+    OMP("omp single")
+      nt = omp_get_num_threads ();
 
-    OMP("omp for")
-      for (k = 0; k < nv; ++k)
-	XENDOFF(k) = XOFF(k);
-    OMP("omp single") {
-      XOFF(nv) = accum;
-      if (!(xadjstore = xmalloc_large_ext ((XOFF(nv) + MINVECT_SIZE) * sizeof (*xadjstore))))
-	err = -1;
-      if (!err) {
-	xadj = &xadjstore[MINVECT_SIZE]; /* Cheat and permit xadj[-1] to work. */
-	for (k = 0; k < XOFF(nv) + MINVECT_SIZE; ++k)
-	  xadjstore[k] = -1;
+  blk_shift = 6;
+  while ((nv >> blk_shift) > BLOCKS_PER_THREAD * nt)
+    ++blk_shift;
+  nblk = (nv + ((int64_t)1 << blk_shift) - 1) >> blk_shift;
+  round_len = (nv > MIN_ROUND_LEN? nv : MIN_ROUND_LEN);
+  if (round_len > nedge) round_len = nedge;
+
+  round_cnt = xmalloc (nt * nblk * sizeof (*round_cnt));
+  round_blk = xmalloc ((nblk+1) * sizeof (*round_blk));
+  round_edge = xmalloc_large (2 * (round_len > 0? round_len : 1) * sizeof (*round_edge));
+  return !(round_cnt && round_blk && round_edge);
+}
+
+static void
+free_rounds (void)
+{
+  xfree_large (round_edge);
+  free (round_blk);
+  free (round_cnt);
+}
+
+/* Partition the directed edges of IJ[r0, r1) by source block.  Called
+   by every thread of the team; ends with a barrier. */
+static void
+partition_round (const struct packed_edge * restrict IJ, int64_t r0, int64_t r1)
+{
+  const int nt = omp_get_num_threads (), tid = omp_get_thread_num ();
+  int64_t * restrict cnt = &round_cnt[tid * nblk];
+  const int64_t kb = r0 + (r1 - r0) * tid / nt;
+  const int64_t ke = r0 + (r1 - r0) * (tid+1) / nt;
+  int64_t k, b;
+
+  for (b = 0; b < nblk; ++b)
+    cnt[b] = 0;
+  for (k = kb; k < ke; ++k) {
+    const int64_t i = get_v0_from_edge(&IJ[k]);
+    const int64_t j = get_v1_from_edge(&IJ[k]);
+    if (i >= 0 && j >= 0 && i != j) { /* Skip self-edges. */
+      ++cnt[i >> blk_shift];
+      ++cnt[j >> blk_shift];
+    }
+  }
+  OMP("omp barrier");
+  OMP("omp single") {
+    int64_t acc = 0;
+    int t;
+    for (b = 0; b < nblk; ++b) {
+      round_blk[b] = acc;
+      for (t = 0; t < nt; ++t) {
+	const int64_t c = round_cnt[t * nblk + b];
+	round_cnt[t * nblk + b] = acc;
+	acc += c;
       }
     }
+    round_blk[nblk] = acc;
   }
-  return !xadj;
+  for (k = kb; k < ke; ++k) {
+    const int64_t i = get_v0_from_edge(&IJ[k]);
+    const int64_t j = get_v1_from_edge(&IJ[k]);
+    if (i >= 0 && j >= 0 && i != j) {
+      struct dir_edge * restrict e;
+      e = &round_edge[cnt[i >> blk_shift]++];
+      e->i = i; e->j = j;
+      e = &round_edge[cnt[j >> blk_shift]++];
+      e->i = j; e->j = i;
+    }
+  }
+  OMP("omp barrier");
 }
 
+/* Turn the degrees counted in BXOFF into offsets padded to
+   MINVECT_SIZE, then allocate, place and clear bxadj.  Called by every
+   thread of the team; bxadj stays NULL on failure. */
 static void
-scatter_edge (const int64_t i, const int64_t j)
+setup_offsets (void)
 {
-  int64_t where;
-  where = int64_fetch_add (&XENDOFF(i), 1);
-  xadj[where] = j;
+  static int64_t *buf;
+  int64_t k, kb, ke, accum;
+  int p;
+
+  OMP("omp single") {
+    buf = alloca (omp_get_num_threads () * sizeof (*buf));
+    if (!buf) {
+      perror ("alloca for prefix-sum hosed");
+      abort ();
+    }
+  }
+  OMP("omp for")
+    for (k = 0; k < nv; ++k)
+      if (BXOFF(k) < MINVECT_SIZE) BXOFF(k) = MINVECT_SIZE;
+
+  accum = prefix_sum (buf);
+
+  OMP("omp for")
+    for (k = 0; k < nv; ++k)
+      BXENDOFF(k) = BXOFF(k);
+  OMP("omp single") {
+    BXOFF(nv) = accum;
+    if ((xadjstore = xmalloc_large_ext ((BXOFF(nv) + MINVECT_SIZE) * sizeof (*xadjstore)))) {
+      part_adj[0] = 0;
+      for (p = 1; p < npart; ++p)
+	part_adj[p] = MINVECT_SIZE + BXOFF(part_lo[p]);
+      part_adj[npart] = MINVECT_SIZE + BXOFF(nv);
+      numa_place (xadjstore, sizeof (*xadjstore), part_adj);
+      bxadj = &xadjstore[MINVECT_SIZE]; /* Cheat and permit bxadj[-1] to work. */
+    }
+  }
+  if (bxadj) {
+    for (p = 0; p < npart; ++p) {
+      numa_share (p, part_adj, &kb, &ke);
+      for (k = kb; k < ke; ++k)
+	xadjstore[k] = -1;
+    }
+  }
+  OMP("omp barrier");
 }
 
 static int
-i64cmp (const void *a, const void *b)
+setup_deg_off (const struct packed_edge * restrict IJ, int64_t nedge)
 {
-  const int64_t ia = *(const int64_t*)a;
-  const int64_t ib = *(const int64_t*)b;
-  if (ia < ib) return -1;
-  if (ia > ib) return 1;
-  return 0;
+  bxadj = NULL;
+  OMP("omp parallel") {
+    int64_t k, kb, ke, r0;
+    int p;
+    for (p = 0; p < npart; ++p) {
+      numa_share (p, part_xoff, &kb, &ke);
+      for (k = kb; k < ke; ++k)
+	bxoff[k] = 0;
+    }
+    OMP("omp barrier");
+    for (r0 = 0; r0 < nedge; r0 += round_len) {
+      int64_t b;
+      partition_round (IJ, r0, (r0 + round_len < nedge? r0 + round_len : nedge));
+      OMP("omp for schedule(dynamic,1)")
+	for (b = 0; b < nblk; ++b)
+	  for (k = round_blk[b]; k < round_blk[b+1]; ++k)
+	    ++BXOFF(round_edge[k].i);
+    }
+    setup_offsets ();
+  }
+  return !bxadj;
 }
 
+/* PACK_QSORT in the environment selects the old per-list qsort for
+   comparison. */
 static void
-pack_vtx_edges (const int64_t i)
+pack_edges (void)
 {
-  int64_t kcur, k;
-  if (XOFF(i)+1 >= XENDOFF(i)) return;
-  qsort (&xadj[XOFF(i)], XENDOFF(i)-XOFF(i), sizeof(*xadj), i64cmp);
-  kcur = XOFF(i);
-  for (k = XOFF(i)+1; k < XENDOFF(i); ++k)
-    if (xadj[k] != xadj[kcur])
-      xadj[++kcur] = xadj[k];
-  ++kcur;
-  for (k = kcur; k < XENDOFF(i); ++k)
-    xadj[k] = -1;
-  XENDOFF(i) = kcur;
+  const int use_qsort = getenv ("PACK_QSORT") != NULL;
+  double t = timestamp ();
+
+  OMP("omp parallel")
+    adjsort_pack_vid (nv, bxoff, bxadj, use_qsort);
+  report_result ("pack_engine: %s", use_qsort? "qsort" : "adjsort");
+  report_result ("pack_time: %20.17e", timestamp () - t);
 }
 
 static void
-pack_edges (void)
+gather_edges (const struct packed_edge * restrict IJ, int64_t nedge)
 {
-  int64_t v;
+  OMP("omp parallel") {
+    int64_t k, r0;
 
-  OMP("omp for")
-    for (v = 0; v < nv; ++v)
-      pack_vtx_edges (v);
+    for (r0 = 0; r0 < nedge; r0 += round_len) {
+      int64_t b;
+      partition_round (IJ, r0, (r0 + round_len < nedge? r0 + round_len : nedge));
+      OMP("omp for schedule(dynamic,1)")
+	for (b = 0; b < nblk; ++b)
+	  for (k = round_blk[b]; k < round_blk[b+1]; ++k) {
+	    const struct dir_edge e = round_edge[k];
+	    bxadj[BXENDOFF(e.i)++] = e.j;
+	  }
+    }
+  }
+
+  pack_edges ();
 }
 
-static void
-gather_edges (const struct packed_edge * restrict IJ, int64_t nedge)
+/* Final layout.  Copy the lists out of the construction arrays into
+   a dense xadj indexed by a single nv+1 offset array, then free the
+   construction arrays, storing the bytes saved in *saved.  On failure
+   they stay, and xoff and xadj are untouched. */
+static int
+compact_graph (int64_t *saved)
 {
+  const int64_t old_bytes = (2*nv+2) * (int64_t)sizeof (*bxoff)
+    + (BXOFF(nv) + MINVECT_SIZE) * (int64_t)sizeof (*xadjstore);
+  int64_t * restrict noff, *tsum, bound[NUMA_MAX+1];
+  vid_t * restrict nadj;
+  int p;
+
+  noff = xmalloc_large ((nv+1) * sizeof (*noff));
+  tsum = xmalloc ((omp_get_max_threads () + 1) * sizeof (*tsum));
+  if (!noff) {
+    free (tsum);
+    return -1;
+  }
+  for (p = 0; p < npart; ++p)
+    bound[p] = part_lo[p];
+  bound[npart] = nv+1;
+  numa_place (noff, sizeof (*noff), bound);
   OMP("omp parallel") {
-    int64_t k;
+    const int nt = omp_get_num_threads (), tid = omp_get_thread_num ();
+    const int64_t kb = nv * tid / nt, ke = nv * (tid+1) / nt;
+    int64_t k, acc = 0;
 
-    OMP("omp for")
-      for (k = 0; k < nedge; ++k) {
-	int64_t i = get_v0_from_edge(&IJ[k]);
-	int64_t j = get_v1_from_edge(&IJ[k]);
-	if (i >= 0 && j >= 0 && i != j) {
-	  scatter_edge (i, j);
-	  scatter_edge (j, i);
-	}
-      }
+    for (k = kb; k < ke; ++k) {
+      noff[k] = acc;
+      acc += BXENDOFF(k) - BXOFF(k);
+    }
+    tsum[tid+1] = acc;
+    OMP("omp barrier");
+    OMP("omp single") {
+      tsum[0] = 0;
+      for (k = 0; k < nt; ++k)
+	tsum[k+1] += tsum[k];
+      noff[nv] = tsum[nt];
+    }
+    for (k = kb; k < ke; ++k)
+      noff[k] += tsum[tid];
+  }
+  free (tsum);
 
-    pack_edges ();
+  nadj = xmalloc_large_ext ((noff[nv] > 0? noff[nv] : 1) * sizeof (*nadj));
+  if (!nadj) {
+    xfree_large (noff);
+    return -1;
+  }
+  for (p = 0; p <= npart; ++p)
+    part_adj[p] = noff[part_lo[p]];
+  numa_place (nadj, sizeof (*nadj), part_adj);
+  OMP("omp parallel") {
+    int64_t k, kb, ke;
+    for (p = 0; p < npart; ++p) {
+      numa_share (p, part_lo, &kb, &ke);
+      for (k = kb; k < ke; ++k)
+	memcpy (&nadj[noff[k]], &bxadj[BXOFF(k)],
+		(noff[k+1] - noff[k]) * sizeof (*nadj));
+    }
   }
+
+  xfree_large (xadjstore);
+  xfree_large (bxoff);
+  xadjstore = bxadj = NULL;
+  bxoff = NULL;
+  xoff = noff;
+  xadj = nadj;
+  sz = (nv+1) * sizeof (*xoff);
+  *saved = old_bytes - (int64_t)sz - xoff[nv] * (int64_t)sizeof (*xadj);
+  return 0;
 }
 
-int
-create_graph_from_edgelist (struct packed_edge *IJ, int64_t nedge)
+/* Copy a mapped snapshot into private memory before xadj is changed
+   in place. */
+static int
+unshare_graph (void)
 {
-  find_nv (IJ, nedge);
-  if (alloc_graph (nedge)) return -1;
-  if (setup_deg_off (IJ, nedge)) {
-    xfree_large (xoff);
+  int64_t * restrict noff, bound[NUMA_MAX+1];
+  vid_t * restrict nadj;
+  int p;
+
+  if (!snap.base) return 0;
+  noff = xmalloc_large_ext ((nv+1) * sizeof (*noff));
+  nadj = xmalloc_large_ext ((xoff[nv] > 0? xoff[nv] : 1) * sizeof (*nadj));
+  if (!noff || !nadj) {
+    if (noff) xfree_large (noff);
+    if (nadj) xfree_large (nadj);
     return -1;
   }
-  gather_edges (IJ, nedge);
+  for (p = 0; p < npart; ++p)
+    bound[p] = part_lo[p];
+  bound[npart] = nv+1;
+  numa_place (noff, sizeof (*noff), bound);
+  numa_place (nadj, sizeof (*nadj), part_adj);
+  memcpy (noff, xoff, (nv+1) * sizeof (*noff));
+  memcpy (nadj, xadj, xoff[nv] * sizeof (*nadj));
+  csr_snapshot_unmap (&snap);
+  xoff = noff;
+  xadj = nadj;
   return 0;
 }
 
-static void
-fill_bitmap_from_queue(bitmap_t *bm, int64_t *vlist, int64_t out, int64_t in)
+/* Vertex reordering.  REORDER=degree relabels vertices by descending
+   degree, REORDER=rcm by reverse Cuthill-McKee, and REORDER=bfs in
+   breadth-first order from REORDER_PIVOT (default: a vertex of
+   maximum degree).  The graph is rebuilt in the new order, and
+   searches translate roots in and parents out, so callers only
+   ever see original IDs. */
+enum { REORDER_NONE = 0, REORDER_DEGREE, REORDER_RCM, REORDER_BFS };
+static const char *reorder_name[] = { "none", "degree", "rcm", "bfs" };
+
+#define DEG(k) (XENDOFF(k) - XOFF(k))
+
+static int
+degcmp (const void *a, const void *b)
 {
-  OMP("omp for")
-    for (long q_index=out; q_index<in; q_index++)
-      bm_set_bit_atomic(bm, vlist[q_index]);
+  const vid_t ia = *(const vid_t*)a;
+  const vid_t ib = *(const vid_t*)b;
+  if (DEG(ia) != DEG(ib)) return (DEG(ia) < DEG(ib)? -1 : 1);
+  if (ia < ib) return -1;
+  if (ia > ib) return 1;
+  return 0;
 }
 
+/* Counting sort of the vertices by degree, ties in ID order. */
 static void
-fill_queue_from_bitmap(bitmap_t *bm, int64_t *vlist, int64_t *out, int64_t *in,
-		       int64_t *local)
+order_degree (vid_t * restrict order, int descending)
 {
-  OMP("omp single") {
-    *out = 0;
-    *in = 0;
+  int64_t maxdeg = 0, acc = 0, k, d;
+  int64_t *cnt;
+
+  for (k = 0; k < nv; ++k)
+    if (DEG(k) > maxdeg) maxdeg = DEG(k);
+  cnt = xmalloc ((maxdeg+1) * sizeof (*cnt));
+  for (d = 0; d <= maxdeg; ++d)
+    cnt[d] = 0;
+  for (k = 0; k < nv; ++k)
+    ++cnt[DEG(k)];
+  for (d = 0; d <= maxdeg; ++d) {
+    const int64_t dd = (descending? maxdeg - d : d), t = cnt[dd];
+    cnt[dd] = acc;
+    acc += t;
   }
-  OMP("omp barrier");
-  int64_t nodes_per_thread = (nv + omp_get_num_threads() - 1) /
-			     omp_get_num_threads();
-  int64_t i = nodes_per_thread * omp_get_thread_num();
-  int local_index = 0;
-  if (i < nv) {
-    int64_t i_end = i + nodes_per_thread;
-    if (i_end >= nv)
-      i_end = nv;
-    if (bm_get_bit(bm, i))
-      local[local_index++] = i;
-    i = bm_get_next_bit(bm,i);
-    while ((i != -1) && (i < i_end)) {
-      local[local_index++] = i;
-      i = bm_get_next_bit(bm,i);
-      if (local_index == THREAD_BUF_LEN) {
-	int my_in = int64_fetch_add(in, THREAD_BUF_LEN);
-	for (local_index=0; local_index<THREAD_BUF_LEN; local_index++) {
-	  vlist[my_in + local_index] = local[local_index];
+  for (k = 0; k < nv; ++k)
+    order[cnt[DEG(k)]++] = k;
+  free (cnt);
+}
+
+/* Breadth-first numbering into order, from pivot (if nonnegative)
+   and then from each unnumbered vertex of start (0..nv-1 if NULL).
+   With rcm, each vertex's new neighbors are numbered by ascending
+   degree and the final order is reversed.  Leaves perm_new set. */
+static void
+order_traversal (vid_t * restrict order, const vid_t * restrict start,
+		 int64_t pivot, int rcm)
+{
+  int64_t head = 0, tail = 0, s, k;
+
+  for (k = 0; k < nv; ++k)
+    perm_new[k] = -1;
+  for (s = -1; s < nv; ++s) {
+    const int64_t r = (s < 0? pivot : (start? start[s] : s));
+    if (r < 0 || perm_new[r] >= 0) continue;
+    perm_new[r] = tail;
+    order[tail++] = r;
+    while (head < tail) {
+      const int64_t v = order[head++], first = tail;
+      int64_t vo;
+      for (vo = XOFF(v); vo < XENDOFF(v); ++vo) {
+	const vid_t j = xadj[vo];
+	if (perm_new[j] < 0) {
+	  perm_new[j] = tail;
+	  order[tail++] = j;
 	}
-	local_index = 0;
+      }
+      if (rcm && tail - first > 1) {
+	qsort (&order[first], tail - first, sizeof (*order), degcmp);
+	for (k = first; k < tail; ++k)
+	  perm_new[order[k]] = k;
       }
     }
   }
-  int my_in = int64_fetch_add(in, local_index);
-  for (int i=0; i<local_index; i++) {
-    vlist[my_in + i] = local[i];
+  if (rcm) {
+    for (k = 0; k < nv/2; ++k) {
+      const vid_t t = order[k];
+      order[k] = order[nv-1-k];
+      order[nv-1-k] = t;
+    }
+    for (k = 0; k < nv; ++k)
+      perm_new[order[k]] = k;
   }
 }
 
-static int64_t
-bfs_bottom_up_step(int64_t *bfs_tree, bitmap_t *past, bitmap_t *next)
+/* Rebuild xoff and xadj with vertex n holding the relabeled list of
+   original vertex perm_old[n], through the construction layout. */
+static int
+relabel_graph (void)
 {
-  OMP("omp single") {
-    bm_swap(past, next);
-  }
-  OMP("omp barrier");
-  bm_reset(next);
-  static int64_t awake_count;
-  OMP("omp single")
-    awake_count = 0;
-  OMP("omp barrier");
-  OMP("omp for reduction(+ : awake_count)")
-    for (int64_t i=0; i<nv; i++) {
-      if (bfs_tree[i] == -1) {
-	  for (int64_t vo = XOFF(i); vo < XENDOFF(i); vo++) {
-	    const int64_t j = xadj[vo];
-	  if (bm_get_bit(past, j)) {
-	    // printf("%lu\n",i);
-	    bfs_tree[i] = j;
-	    bm_set_bit_atomic(next, i);
-	    awake_count++;
-	    break;
-	  }
-	}
+  int64_t * restrict oxoff = xoff;
+  vid_t * restrict oxadj = xadj;
+  int64_t saved;
+
+  if (alloc_graph (0)) return -1;
+  bxadj = NULL;
+  OMP("omp parallel") {
+    int64_t n, k, kb, ke;
+    int p;
+    for (p = 0; p < npart; ++p) {
+      numa_share (p, part_lo, &kb, &ke);
+      for (n = kb; n < ke; ++n) {
+	const vid_t o = perm_old[n];
+	BXOFF(n) = oxoff[o+1] - oxoff[o];
+	BXENDOFF(n) = 0;
       }
     }
-  OMP("omp barrier");
-  return awake_count;
+    OMP("omp single")
+      BXOFF(nv) = BXENDOFF(nv) = 0;
+    setup_offsets ();
+    if (bxadj) {
+      OMP("omp for schedule(dynamic,256)")
+	for (n = 0; n < nv; ++n) {
+	  const vid_t o = perm_old[n];
+	  for (k = oxoff[o]; k < oxoff[o+1]; ++k)
+	    bxadj[BXENDOFF(n)++] = perm_new[oxadj[k]];
+	}
+      adjsort_pack_vid (nv, bxoff, bxadj, 0);
+    }
+  }
+  if (!bxadj || compact_graph (&saved)) {
+    if (bxadj) xfree_large (xadjstore);
+    xfree_large (bxoff);
+    xoff = oxoff;
+    xadj = oxadj;
+    return -1;
+  }
+  if (snap.base)
+    csr_snapshot_unmap (&snap);
+  else {
+    xfree_large (oxadj);
+    xfree_large (oxoff);
+  }
+  return 0;
 }
 
 static void
-bfs_top_down_step(int64_t *bfs_tree, int64_t *vlist, int64_t *local, int64_t *k1_p, int64_t *k2_p)
+reorder_graph (void)
 {
-  const int64_t oldk2 = *k2_p;
-  int64_t kbuf = 0;
-  OMP("omp barrier");
-  OMP("omp for")
-	for (int64_t k = *k1_p; k < oldk2; ++k) {
-	  const int64_t v = vlist[k];
-	  const int64_t veo = XENDOFF(v);
-	  int64_t vo;
-	  for (vo = XOFF(v); vo < veo; ++vo) {
-	    const int64_t j = xadj[vo];
-	    if (bfs_tree[j] == -1) {
-	      if (int64_cas (&bfs_tree[j], -1, v)) {
-		if (kbuf < THREAD_BUF_LEN) {
-		  local[kbuf++] = j;
-		} else {
-		  int64_t voff = int64_fetch_add (k2_p, THREAD_BUF_LEN), vk;
-		  assert (voff + THREAD_BUF_LEN <= nv);
-		  for (vk = 0; vk < THREAD_BUF_LEN; ++vk)
-		    vlist[voff + vk] = local[vk];
-		  local[0] = j;
-		  kbuf = 1;
-		}
-	      }
-	    }
+  const char *s = getenv ("REORDER");
+  int mode = REORDER_NONE;
+  double t;
+  int64_t k;
+
+  if (!s) return;
+  for (k = 0; k < sizeof (reorder_name) / sizeof (*reorder_name); ++k)
+    if (!strcmp (s, reorder_name[k])) mode = k;
+  if (mode == REORDER_NONE) {
+    if (strcmp (s, "none"))
+      fprintf (stderr, "Unknown REORDER %s, not reordering.\n", s);
+    return;
+  }
+
+  t = timestamp ();
+  perm_new = xmalloc_large (nv * sizeof (*perm_new));
+  perm_old = xmalloc_large (nv * sizeof (*perm_old));
+  if (mode == REORDER_DEGREE) {
+    order_degree (perm_old, 1);
+    OMP("omp parallel for")
+      for (k = 0; k < nv; ++k)
+	perm_new[perm_old[k]] = k;
+  } else if (mode == REORDER_RCM) {
+    vid_t *start = xmalloc_large (nv * sizeof (*start));
+    order_degree (start, 0);
+    order_traversal (perm_old, start, -1, 1);
+    xfree_large (start);
+  } else {
+    int64_t pivot = (getenv ("REORDER_PIVOT")? strtoll (getenv ("REORDER_PIVOT"), NULL, 10) : -1);
+    if (pivot < 0 || pivot >= nv) {
+      pivot = 0;
+      for (k = 1; k < nv; ++k)
+	if (DEG(k) > DEG(pivot)) pivot = k;
+    }
+    order_traversal (perm_old, NULL, pivot, 0);
+  }
+
+  if (relabel_graph ()) {
+    fprintf (stderr, "Failed to rebuild the reordered graph, not reordering.\n");
+    xfree_large (perm_old);
+    xfree_large (perm_new);
+    perm_new = perm_old = NULL;
+    return;
+  }
+  report_result ("reorder: %s", reorder_name[mode]);
+  report_result ("reorder_time: %20.17e", timestamp () - t);
+}
+
+/* Neighbor ordering, enabled by ADJ_ORDER.  Bottom-up stops at the
+   first neighbor in the frontier, and high-degree neighbors are the
+   likeliest to be there.  "degree" sorts whole lists by descending
+   neighbor degree; "hub" moves only the ADJ_HUB_PREFIX (default 16)
+   highest-degree neighbors to the front and keeps the rest ascending.
+   The gain is measured as bottom-up probes per checked vertex over an
+   all-bottom-up search from the highest-degree vertex, before and
+   after. */
+static int
+hubcmp (const void *a, const void *b)
+{
+  return degcmp (b, a);
+}
+
+static double
+bu_probe_rate (void)
+{
+  bitmap_t seen = {0}, past = {0}, next = {0};
+  int64_t root = 0, probes = 0, checks = 0, awake = 1, k;
+
+  for (k = 1; k < nv; ++k)
+    if (DEG(k) > DEG(root)) root = k;
+  if (bm_init (&seen, nv) || bm_init (&past, nv) || bm_init (&next, nv)) {
+    bm_free (&next);
+    bm_free (&past);
+    bm_free (&seen);
+    return 0;
+  }
+  bm_set_bit (&seen, root);
+  bm_set_bit (&past, root);
+  while (awake) {
+    awake = 0;
+    OMP("omp parallel for schedule(dynamic, 1024) reduction(+ : probes, checks, awake)")
+      for (k = 0; k < nv; ++k) {
+	int64_t vo;
+	if (bm_get_bit (&seen, k) || !DEG(k)) continue;
+	++checks;
+	for (vo = XOFF(k); vo < XENDOFF(k); ++vo) {
+	  ++probes;
+	  if (bm_get_bit (&past, xadj[vo])) {
+	    bm_set_bit_atomic (&next, k);
+	    ++awake;
+	    break;
 	  }
 	}
-  if (kbuf) {
-	int64_t voff = int64_fetch_add (k2_p, kbuf), vk;
-	assert (voff + kbuf <= nv);
-	for (vk = 0; vk < kbuf; ++vk)
-	  vlist[voff + vk] = local[vk];
+      }
+    OMP("omp parallel for")
+      for (k = 0; k < seen.end - seen.start; ++k) {
+	seen.start[k] |= next.start[k];
+	past.start[k] = next.start[k];
+	next.start[k] = 0;
+      }
   }
-  OMP("omp single")
-    *k1_p = oldk2;
-  OMP("omp barrier");
-  return;
+  bm_free (&next);
+  bm_free (&past);
+  bm_free (&seen);
+  return (checks? (double)probes / checks : 0);
 }
 
-int
-make_bfs_tree (int64_t *bfs_tree_out, int64_t *max_vtx_out,
-	       int64_t srcvtx)
+static int adj_ordered;
+
+static void
+order_adjacency (void)
 {
-  int64_t * restrict bfs_tree = bfs_tree_out;
-  int err = 0;
+  const char *s = getenv ("ADJ_ORDER");
+  int64_t maxdeg = 0, hub = -1, k;
+  double t, before;
 
-  int64_t * restrict vlist = NULL;
-  int64_t k1, k2;
+  if (!s) return;
+  if (!strcmp (s, "hub")) {
+    hub = (getenv ("ADJ_HUB_PREFIX")? atoll (getenv ("ADJ_HUB_PREFIX")) : 16);
+    if (hub < 1) hub = 1;
+  } else if (strcmp (s, "degree")) {
+    if (strcmp (s, "none"))
+      fprintf (stderr, "Unknown ADJ_ORDER %s, keeping ascending lists.\n", s);
+    return;
+  }
+  if (getenv ("ADJ_COMPRESS")) {
+    fprintf (stderr, "ADJ_ORDER needs ascending lists under ADJ_COMPRESS, ignoring it.\n");
+    return;
+  }
+  if (unshare_graph ()) {
+    fprintf (stderr, "Cannot copy the mapped CSR snapshot, ignoring ADJ_ORDER.\n");
+    return;
+  }
 
-  *max_vtx_out = maxvtx;
+  t = timestamp ();
+  before = bu_probe_rate ();
+  for (k = 0; k < nv; ++k)
+    if (DEG(k) > maxdeg) maxdeg = DEG(k);
+  OMP("omp parallel") {
+    vid_t *tmp = (hub > 0? xmalloc (2 * (maxdeg + 1) * sizeof (*tmp)) : NULL);
+    int64_t v;
+    OMP("omp for schedule(dynamic, 256)")
+      for (v = 0; v < nv; ++v) {
+	vid_t * restrict adj = &xadj[XOFF(v)];
+	const int64_t deg = DEG(v);
+	int64_t i, j, n;
+	if (deg < 2) continue;
+	if (hub < 0 || deg <= hub) {
+	  qsort (adj, deg, sizeof (*adj), hubcmp);
+	  continue;
+	}
+	/* Hubs first, then the remaining neighbors in their ascending
+	   order. */
+	memcpy (tmp, adj, deg * sizeof (*tmp));
+	memcpy (&tmp[deg], adj, deg * sizeof (*tmp));
+	qsort (&tmp[deg], deg, sizeof (*tmp), hubcmp);
+	memcpy (adj, &tmp[deg], hub * sizeof (*tmp));
+	n = hub;
+	for (i = 0; i < deg; ++i) {
+	  for (j = 0; j < hub; ++j)
+	    if (adj[j] == tmp[i]) break;
+	  if (j == hub) adj[n++] = tmp[i];
+	}
+      }
+    free (tmp);
+  }
+  adj_ordered = 1;
+  report_result ("adj_order: %s", s);
+  report_result ("bu_probes_per_vertex_ascending: %g", before);
+  report_result ("bu_probes_per_vertex_ordered: %g", bu_probe_rate ());
+  report_result ("adj_order_time: %20.17e", timestamp () - t);
+}
 
-  vlist = xmalloc_large (nv * sizeof (*vlist));
-  if (!vlist) return -1;
+#undef DEG
 
-  vlist[0] = srcvtx;
-  k1 = 0; k2 = 1;
-  bfs_tree[srcvtx] = srcvtx;
+/* Compressed adjacency, enabled by ADJ_COMPRESS.  After packing, list
+   v is re-encoded into cadj[coff[v] .. coff[v+1]) and xadj is freed;
+   xoff still gives the degrees.  Neighbors form blocks of CADJ_BLOCK.
+   The first of a block is stored as its zigzagged difference from v,
+   the others as the gap to the previous neighbor minus one, all as
+   LEB128 byte varints.  Lists of more than one block start with a
+   table of 32-bit offsets of blocks 1.. from the end of the table, so
+   a hub list can be entered at any block. */
+#define CADJ_BLOCK 128
+#define CADJ_NBLK(deg) (((deg) + CADJ_BLOCK - 1) / CADJ_BLOCK)
+#define CADJ_TABLE(deg) ((deg) > CADJ_BLOCK? 4 * (CADJ_NBLK(deg) - 1) : 0)
 
-  bitmap_t past, next;
-  bm_init(&past, nv);
-  bm_init(&next, nv);
 
-  int64_t down_cutoff = nv / BETA;
-  int64_t scout_count = XENDOFF(srcvtx) - XOFF(srcvtx);
+#define ZIGZAG(d) (((uint64_t)(d) << 1) ^ (uint64_t)((d) >> 63))
+#define UNZIGZAG(x) ((int64_t)((x) >> 1) ^ -(int64_t)((x) & 1))
 
-  OMP("omp parallel shared(k1, k2, scout_count)") {
-    int64_t k;
-    int64_t nbuf[THREAD_BUF_LEN];
-    int64_t awake_count = 1;
-    int64_t edges_to_check = XOFF(nv);
+static inline int
+varint_len (uint64_t x)
+{
+  int n = 1;
+  for (; x >= 0x80; x >>= 7)
+    ++n;
+  return n;
+}
 
-    OMP("omp for")
-      for (k = 0; k < srcvtx; ++k)
-	bfs_tree[k] = -1;
-    OMP("omp for")
-      for (k = srcvtx+1; k < nv; ++k)
-	bfs_tree[k] = -1;
+static inline uint8_t *
+varint_put (uint8_t *p, uint64_t x)
+{
+  for (; x >= 0x80; x >>= 7)
+    *p++ = (uint8_t)(x | 0x80);
+  *p++ = (uint8_t)x;
+  return p;
+}
+
+static inline uint64_t
+varint_get (const uint8_t **pp)
+{
+  const uint8_t *p = *pp;
+  uint64_t x = *p++;
+  if (x & 0x80) {
+    uint64_t b;
+    int s = 7;
+    x &= 0x7f;
+    do {
+      b = *p++;
+      x |= (b & 0x7f) << s;
+      s += 7;
+    } while (b & 0x80);
+  }
+  *pp = p;
+  return x;
+}
+
+/* Encoded value of neighbor k of v. */
+static inline uint64_t
+cadj_code (int64_t v, const vid_t *adj, int64_t k)
+{
+  return (k & (CADJ_BLOCK-1)? (uint64_t)(adj[k] - adj[k-1] - 1)
+	  : ZIGZAG((int64_t)adj[k] - v));
+}
+
+/* Start of the neighbors of v, past its block table. */
+static inline const uint8_t *
+cadj_list (int64_t v, int64_t deg)
+{
+  return cadj + coff[v] + CADJ_TABLE(deg);
+}
+
+/* Decode neighbor k of v, following prev. */
+static inline vid_t
+cadj_next (const uint8_t **p, int64_t k, int64_t v, vid_t prev)
+{
+  const uint64_t x = varint_get (p);
+  return (k & (CADJ_BLOCK-1)? prev + 1 + (vid_t)x : (vid_t)(v + UNZIGZAG(x)));
+}
+
+static int64_t
+cadj_size (int64_t v)
+{
+  const int64_t deg = XENDOFF(v) - XOFF(v);
+  const vid_t *adj = &xadj[XOFF(v)];
+  int64_t k, n = CADJ_TABLE(deg);
+  for (k = 0; k < deg; ++k)
+    n += varint_len (cadj_code (v, adj, k));
+  return n;
+}
+
+static void
+cadj_encode (int64_t v)
+{
+  const int64_t deg = XENDOFF(v) - XOFF(v);
+  const vid_t *adj = &xadj[XOFF(v)];
+  uint8_t *table = cadj + coff[v];
+  uint8_t *data = table + CADJ_TABLE(deg), *p = data;
+  int64_t k;
+  for (k = 0; k < deg; ++k) {
+    if (k && !(k & (CADJ_BLOCK-1))) {
+      const uint32_t off = (uint32_t)(p - data);
+      memcpy (table + 4 * (k / CADJ_BLOCK - 1), &off, sizeof (off));
+    }
+    p = varint_put (p, cadj_code (v, adj, k));
+  }
+}
+
+static void
+compress_graph (void)
+{
+  const int64_t csr_bytes = (int64_t)sz
+    + XOFF(nv) * (int64_t)sizeof (*xadj);
+  int64_t *tsum, nadj = 0;
+  int failed = 0, p;
+  double t;
+
+  OMP("omp parallel for reduction(+ : nadj)")
+    for (int64_t k = 0; k < nv; ++k)
+      nadj += XENDOFF(k) - XOFF(k);
+  if (!nadj) nadj = 1;
+  report_result ("csr_bytes_per_edge: %g", (double)csr_bytes / nadj);
+  if (!getenv ("ADJ_COMPRESS")) return;
+
+  t = timestamp ();
+  coff = xmalloc_large ((nv+1) * sizeof (*coff));
+  tsum = xmalloc ((omp_get_max_threads () + 1) * sizeof (*tsum));
+  OMP("omp parallel") {
+    const int nt = omp_get_num_threads (), tid = omp_get_thread_num ();
+    const int64_t kb = nv * tid / nt, ke = nv * (tid+1) / nt;
+    int64_t k, acc = 0;
+
+    for (k = kb; k < ke; ++k) {
+      coff[k] = acc;
+      acc += cadj_size (k);
+    }
+    tsum[tid+1] = acc;
+    OMP("omp barrier");
+    OMP("omp single") {
+      tsum[0] = 0;
+      for (k = 0; k < nt; ++k)
+	tsum[k+1] += tsum[k];
+      coff[nv] = tsum[nt];
+    }
+    for (k = kb; k < ke; ++k)
+      coff[k] += tsum[tid];
+    OMP("omp barrier");
+    OMP("omp single") {
+      cadj = xmalloc_large_ext (coff[nv] + 1);
+      if (cadj) {
+	for (p = 0; p <= npart; ++p)
+	  part_cadj[p] = coff[part_lo[p]];
+	numa_place (cadj, 1, part_cadj);
+      } else
+	failed = 1;
+    }
+    if (!failed) {
+      int q;
+      int64_t b, e;
+      for (q = 0; q < npart; ++q) {
+	numa_share (q, part_lo, &b, &e);
+	for (k = b; k < e; ++k)
+	  cadj_encode (k);
+      }
+    }
+  }
+  free (tsum);
+  if (failed) {
+    fprintf (stderr, "Cannot allocate the compressed adjacency, keeping the CSR.\n");
+    xfree_large (coff);
+    coff = NULL;
+    return;
+  }
+  if (!snap.base) xfree_large (xadj);
+  xadj = NULL;
+  report_result ("compressed_bytes_per_edge: %g",
+		 (double)(sz + (nv+1) * sizeof (*coff) + coff[nv]) / nadj);
+  report_result ("compress_time: %20.17e", timestamp () - t);
+}
+
+/* Count the vertices of each degree class; the hub count sizes the
+   frontiers' hub lists. */
+static void
+setup_classes (void)
+{
+  int64_t ntiny = 0, nhub = 0;
+
+  OMP("omp parallel for reduction(+ : ntiny, nhub)")
+    for (int64_t k = 0; k < nv; ++k) {
+      const int64_t deg = XENDOFF(k) - XOFF(k);
+      if (deg && deg <= VC_TINY) ++ntiny;
+      else if (deg >= VC_HUB) ++nhub;
+    }
+  vc_nhub = nhub;
+  report_result ("degree_class_tiny: %" PRId64, ntiny);
+  report_result ("degree_class_hub: %" PRId64, nhub);
+}
+
+/* Segmented bottom-up, enabled by BU_SEGMENT=<bytes> or llc.  Each
+   bottom-up step then sweeps its candidates once per segment of the
+   vertex range, scanning only the neighbors inside the segment, so
+   the slice of past being probed stays in cache however large the
+   whole bitmap is.  A vertex found in one segment is marked in seen
+   and skipped by the later ones.  A segment covers <bytes> of past,
+   or half the last-level cache with llc.  Needs ascending lists.
+   The segment boundaries take 4 bytes per vertex each; segments are
+   widened so they take at most 1/BU_SEG_FRAC of the CSR arrays. */
+#define BU_SEG_FRAC 4
+
+static void
+setup_segments (void)
+{
+  const char *s = getenv ("BU_SEGMENT");
+  int64_t bytes, nseg, maxseg, maxdeg = 0, k;
+  double t;
+
+  if (!s) return;
+  if (!strcmp (s, "llc")) {
+#if defined(_SC_LEVEL3_CACHE_SIZE)
+    bytes = sysconf (_SC_LEVEL3_CACHE_SIZE) / 2;
+#else
+    bytes = 0;
+#endif
+    if (bytes <= 0) {
+      fprintf (stderr, "Cannot find the last-level cache size, ignoring BU_SEGMENT.\n");
+      return;
+    }
+  } else if ((bytes = atoll (s)) <= 0) {
+    fprintf (stderr, "Unknown BU_SEGMENT %s, ignoring it.\n", s);
+    return;
+  }
+  if (cadj || adj_ordered) {
+    fprintf (stderr, "BU_SEGMENT needs ascending, uncompressed lists, ignoring it.\n");
+    return;
+  }
+
+  t = timestamp ();
+  bu_span = (8 * bytes) & ~(int64_t)63;
+  if (bu_span < 64) bu_span = 64;
+  nseg = (nv + bu_span - 1) / bu_span;
+  maxseg = 1 + ((nv+1) * (int64_t)sizeof (*xoff)
+		+ xoff[nv] * (int64_t)sizeof (*xadj))
+    / (BU_SEG_FRAC * nv * (int64_t)sizeof (*segpos));
+  if (nseg > maxseg) {
+    if (maxseg < 2) {
+      fprintf (stderr, "Too few edges per vertex for BU_SEGMENT, ignoring it.\n");
+      return;
+    }
+    bu_span = ((nv + maxseg - 1) / maxseg + 63) & ~(int64_t)63;
+    nseg = (nv + bu_span - 1) / bu_span;
+    fprintf (stderr, "Widening the BU_SEGMENT segments to %" PRId64
+	     " vertices to bound their cost.\n", bu_span);
+  }
+  for (k = 0; k < nv; ++k)
+    if (XENDOFF(k) - XOFF(k) > maxdeg) maxdeg = XENDOFF(k) - XOFF(k);
+  if (nseg > 1 && maxdeg > UINT32_MAX) {
+    fprintf (stderr, "Lists too long for BU_SEGMENT, ignoring it.\n");
+    return;
+  }
+  if (nseg > 1 && !(segpos = xmalloc_large_ext ((nseg-1) * nv * sizeof (*segpos)))) {
+    fprintf (stderr, "Cannot allocate the bottom-up segments, ignoring BU_SEGMENT.\n");
+    return;
+  }
+  for (k = 0; k+1 < nseg; ++k)
+    numa_place (&segpos[k*nv], sizeof (*segpos), part_lo);
+  OMP("omp parallel for schedule(dynamic, 1024)")
+    for (k = 0; k < nv; ++k) {
+      const vid_t * restrict adj = &xadj[XOFF(k)];
+      const int64_t n = XENDOFF(k) - XOFF(k);
+      int64_t seg, pos = 0;
+      for (seg = 1; seg < nseg; ++seg) {
+	while (pos < n && adj[pos] < seg * bu_span) ++pos;
+	segpos[(seg-1)*nv + k] = pos;
+      }
+    }
+  bu_nseg = nseg;
+  report_result ("bu_segments: %" PRId64, bu_nseg);
+  report_result ("bu_segment_vertices: %" PRId64, bu_span);
+  report_result ("bu_segment_time: %20.17e", timestamp () - t);
+}
+
+/* Use a matching snapshot at path in place of building the graph. */
+static int
+load_snapshot (const char *path, int64_t nedge)
+{
+  int p;
+
+  if (csr_snapshot_map (path, nedge, sizeof (vid_t), &snap)) return -1;
+  nv = snap.nv;
+  maxvtx = nv-1;
+  numa_setup ();
+  xoff = (int64_t*)snap.off;
+  xadj = (vid_t*)snap.adj;
+  for (p = 0; p <= npart; ++p)
+    part_adj[p] = xoff[part_lo[p]];
+  sz = (nv+1) * sizeof (*xoff);
+  report_result ("csr_snapshot: loaded");
+  return 0;
+}
+
+static void
+save_snapshot (const char *path, int64_t nedge)
+{
+  const double t = timestamp ();
+
+  if (csr_snapshot_write (path, nedge, sizeof (vid_t), nv, xoff, xadj))
+    return;
+  report_result ("csr_snapshot: written");
+  report_result ("csr_snapshot_write_time: %20.17e", timestamp () - t);
+}
+
+int
+create_graph_from_edgelist (struct packed_edge *IJ, int64_t nedge)
+{
+  const char *snapname = getenv ("CSR_SNAPSHOT");
+  int64_t saved;
+
+  nedge_in = nedge;
+  if (snapname && !load_snapshot (snapname, nedge))
+    goto built;
+  find_nv (IJ, nedge);
+  if (maxvtx > VID_MAX) {
+    fprintf (stderr, "%" PRId64 " vertices do not fit in %d-bit vertex IDs.\n",
+	     nv, (int)(8*sizeof (vid_t)));
+    return -1;
+  }
+  numa_setup ();
+  if (alloc_graph (nedge)) return -1;
+  if (alloc_rounds (nedge)) {
+    xfree_large (bxoff);
+    return -1;
+  }
+  if (setup_deg_off (IJ, nedge)) {
+    free_rounds ();
+    xfree_large (bxoff);
+    return -1;
+  }
+  gather_edges (IJ, nedge);
+  free_rounds ();
+  if (compact_graph (&saved)) {
+    xfree_large (xadjstore);
+    xfree_large (bxoff);
+    return -1;
+  }
+  report_result ("csr_compact_saved_bytes: %" PRId64, saved);
+  if (snapname) save_snapshot (snapname, nedge);
+ built:
+  reorder_graph ();
+  order_adjacency ();
+  compress_graph ();
+  setup_classes ();
+  setup_segments ();
+  select_kernels ();
+  setup_levels ();
+  setup_direction ();
+  setup_prefetch ();
+  return 0;
+}
+
+/* Level barriers.  With BFS_BARRIER=spin, level_barrier is a
+   sense-reversing spin barrier: each arriving thread notes the sense,
+   the last to arrive resets the count and flips the sense, and the
+   rest spin until it changes.  That skips the OpenMP runtime's
+   bookkeeping but burns cycles when threads share cores, so spinning
+   threads yield every SPIN_YIELD rounds. */
+#define SPIN_YIELD 1024
+
+static int level_spin;
+static struct {
+  int64_t count;
+  char pad[64 - sizeof (int64_t)];
+  volatile int64_t sense;
+} level_bar;
+
+static void
+level_barrier (void)
+{
+#if defined(__GNUC__)||defined(__INTEL_COMPILER)
+  if (level_spin) {
+    const int64_t sense = level_bar.sense;
+    if (int64_fetch_add (&level_bar.count, 1) == omp_get_num_threads () - 1) {
+      level_bar.count = 0;
+      __sync_synchronize ();
+      level_bar.sense = !sense;
+    } else {
+      int k = 0;
+      while (level_bar.sense == sense) {
+#if defined(__x86_64__)||defined(__i386__)
+	__builtin_ia32_pause ();
+#endif
+	if (++k == SPIN_YIELD) {
+	  sched_yield ();
+	  k = 0;
+	}
+      }
+    }
+    __sync_synchronize ();
+    return;
+  }
+#endif
+  OMP("omp barrier");
+}
+
+/* Frontier queues.  Vertices are appended to fixed-size chunks that
+   threads claim from the frontier's pool with one fetch-and-add, so
+   there is no shared per-vertex counter and no stack staging buffer.
+   Chunk c holds len[c] vertices starting at slot[c*FRONTIER_CHUNK].
+   Each thread keeps its open chunk and running size, degree sum and
+   largest degree in a cursor and publishes them with frontier_flush;
+   after the following barrier, size, edges and maxdeg describe the
+   whole frontier.  hub lists the frontier's nhub hubs, or nhub is -1
+   when they are unknown, and hub_next counts the hub pieces claimed
+   so far.  gsum is scratch for the edge-balanced top-down.  The dense
+   form is a bitmap, converted to and from on demand. */
+#define FRONTIER_CHUNK 1024
+#define FRONTIER_GRAIN 64
+#define FRONTIER_GPC (FRONTIER_CHUNK / FRONTIER_GRAIN)
+
+struct frontier {
+  vid_t * restrict slot;
+  int64_t * restrict len;
+  int64_t * restrict gsum;
+  vid_t * restrict hub; /* Length vc_nhub */
+  int64_t nchunk_max;
+  int64_t nchunk, size, edges, maxdeg;
+  int64_t nhub, hub_next;
+};
+
+struct frontier_cursor {
+  int64_t c, k, size, edges, maxdeg;
+};
+#define FRONTIER_CURSOR_INIT { -1, FRONTIER_CHUNK, 0, 0, 0 }
+
+/* Every vertex enters a level's frontier at most once, and each
+   thread leaves at most one chunk partly filled. */
+static void
+frontier_alloc (struct frontier *fr)
+{
+  fr->nchunk_max = (nv + FRONTIER_CHUNK - 1) / FRONTIER_CHUNK
+    + omp_get_max_threads ();
+  fr->slot = xmalloc_large (fr->nchunk_max * FRONTIER_CHUNK * sizeof (*fr->slot));
+  fr->len = xmalloc_large (fr->nchunk_max * sizeof (*fr->len));
+  fr->gsum = xmalloc_large ((fr->nchunk_max * FRONTIER_GPC + 1) * sizeof (*fr->gsum));
+  fr->hub = xmalloc ((vc_nhub + 1) * sizeof (*fr->hub));
+  fr->nchunk = fr->size = fr->edges = fr->maxdeg = 0;
+  fr->nhub = fr->hub_next = 0;
+}
+
+static void
+frontier_free (struct frontier *fr)
+{
+  free (fr->hub);
+  xfree_large (fr->gsum);
+  xfree_large (fr->len);
+  xfree_large (fr->slot);
+}
+
+/* Called by all threads; ends with a barrier. */
+static void
+frontier_reset (struct frontier *fr)
+{
+  OMP("omp single nowait") {
+    fr->nchunk = fr->size = fr->edges = fr->maxdeg = 0;
+    fr->nhub = fr->hub_next = 0;
+  }
+  level_barrier ();
+}
+
+static inline void
+frontier_push (struct frontier *fr, struct frontier_cursor *cur, vid_t v)
+{
+  const int64_t deg = XENDOFF(v) - XOFF(v);
+  if (cur->k == FRONTIER_CHUNK) {
+    if (cur->c >= 0) fr->len[cur->c] = FRONTIER_CHUNK;
+    cur->c = int64_fetch_add (&fr->nchunk, 1);
+    assert (cur->c < fr->nchunk_max);
+    cur->k = 0;
+  }
+  fr->slot[cur->c * FRONTIER_CHUNK + cur->k++] = v;
+  if (deg >= VC_HUB)
+    fr->hub[int64_fetch_add (&fr->nhub, 1)] = v;
+  ++cur->size;
+  cur->edges += deg;
+  if (deg > cur->maxdeg) cur->maxdeg = deg;
+}
+
+static void
+frontier_maxdeg (struct frontier *fr, int64_t deg)
+{
+  int64_t m = fr->maxdeg;
+  while (deg > m)
+    m = int64_casval (&fr->maxdeg, m, deg);
+}
+
+static void
+frontier_flush (struct frontier *fr, struct frontier_cursor *cur)
+{
+  if (cur->c >= 0) fr->len[cur->c] = cur->k;
+  if (cur->size) {
+    int64_fetch_add (&fr->size, cur->size);
+    int64_fetch_add (&fr->edges, cur->edges);
+    frontier_maxdeg (fr, cur->maxdeg);
+  }
+  cur->c = -1;
+  cur->k = FRONTIER_CHUNK;
+  cur->size = cur->edges = cur->maxdeg = 0;
+}
+
+/* Parallel loops run over grains of FRONTIER_GRAIN slots so a frontier
+   produced by a single thread still spreads across the team.  Grain g
+   covers slots [*kb, *ke), empty past its chunk's length. */
+static inline int64_t
+frontier_grains (const struct frontier *fr)
+{
+  return fr->nchunk * FRONTIER_GPC;
+}
+
+static inline void
+frontier_grain (const struct frontier *fr, int64_t g, int64_t *kb, int64_t *ke)
+{
+  const int64_t c = g / FRONTIER_GPC;
+  const int64_t off = (g % FRONTIER_GPC) * FRONTIER_GRAIN;
+  int64_t end = off + FRONTIER_GRAIN;
+  if (end > fr->len[c]) end = fr->len[c];
+  if (end < off) end = off;
+  *kb = c * FRONTIER_CHUNK + off;
+  *ke = c * FRONTIER_CHUNK + end;
+}
+
+static void
+frontier_to_bitmap (const struct frontier *fr, bitmap_t *bm)
+{
+  OMP("omp for schedule(dynamic)")
+    for (int64_t g = 0; g < frontier_grains (fr); ++g) {
+      int64_t k, ke;
+      frontier_grain (fr, g, &k, &ke);
+      for (; k < ke; ++k)
+	bm_set_bit_atomic (bm, fr->slot[k]);
+    }
+}
+
+/* The bitmap's positions fill the chunks in order.  size, edges and
+   maxdeg are left alone: the bottom-up step that filled bm already
+   counted them.  The hubs are not listed. */
+static void
+frontier_from_bitmap (struct frontier *fr, bitmap_t *bm)
+{
+  const int64_t n = bm_to_queue_vid (bm, fr->slot);
+  const int64_t nchunk = (n + FRONTIER_CHUNK - 1) / FRONTIER_CHUNK;
+  int64_t k;
+
+  OMP("omp single nowait") {
+    fr->nchunk = nchunk;
+    fr->nhub = -1;
+  }
+  OMP("omp for")
+    for (k = 0; k < nchunk; ++k)
+      fr->len[k] = (n - k * FRONTIER_CHUNK < FRONTIER_CHUNK?
+		    n - k * FRONTIER_CHUNK : FRONTIER_CHUNK);
+}
+
+/* Bottom-up probes.  bu_scan_* return the position of the first
+   entry of adj[0..n) whose bit is set in past, or n.  The vector
+   variants test the bits of several neighbors per gather and report
+   the same first hit as the scalar loop. */
+ISA_INLINE int64_t
+bu_scan_scalar (const vid_t * restrict adj, int64_t n,
+		const uint64_t * restrict past)
+{
+  int64_t k;
+  for (k = 0; k < n; ++k) {
+    const vid_t j = adj[k];
+    if (past[WORD_OFFSET(j)] & ((uint64_t)1 << BIT_OFFSET(j))) break;
+  }
+  return k;
+}
+
+#if defined(HAVE_ISA_X86)
+ISA_TARGET("avx2") ISA_INLINE int64_t
+bu_scan_avx2 (const vid_t * restrict adj, int64_t n,
+	      const uint64_t * restrict past)
+{
+  int64_t k = 0;
+#if defined(USE_VID32)
+  const __m256i lowbits = _mm256_set1_epi32 (31), one = _mm256_set1_epi32 (1);
+  for (; k + 8 <= n; k += 8) {
+    const __m256i j = _mm256_loadu_si256 ((const __m256i*)&adj[k]);
+    const __m256i w = _mm256_i32gather_epi32 ((const int*)past,
+					      _mm256_srli_epi32 (j, 5), 4);
+    const __m256i b = _mm256_and_si256 (_mm256_srlv_epi32 (w, _mm256_and_si256 (j, lowbits)), one);
+    const int hit = _mm256_movemask_ps (_mm256_castsi256_ps (_mm256_cmpeq_epi32 (b, one)));
+    if (hit) return k + __builtin_ctz (hit);
+  }
+#else
+  const __m256i lowbits = _mm256_set1_epi64x (63), one = _mm256_set1_epi64x (1);
+  for (; k + 4 <= n; k += 4) {
+    const __m256i j = _mm256_loadu_si256 ((const __m256i*)&adj[k]);
+    const __m256i w = _mm256_i64gather_epi64 ((const long long*)past,
+					      _mm256_srli_epi64 (j, 6), 8);
+    const __m256i b = _mm256_and_si256 (_mm256_srlv_epi64 (w, _mm256_and_si256 (j, lowbits)), one);
+    const int hit = _mm256_movemask_pd (_mm256_castsi256_pd (_mm256_cmpeq_epi64 (b, one)));
+    if (hit) return k + __builtin_ctz (hit);
+  }
+#endif
+  return k + bu_scan_scalar (&adj[k], n - k, past);
+}
+
+ISA_TARGET("avx512f") ISA_INLINE int64_t
+bu_scan_avx512 (const vid_t * restrict adj, int64_t n,
+		const uint64_t * restrict past)
+{
+  int64_t k;
+#if defined(USE_VID32)
+  const __m512i lowbits = _mm512_set1_epi32 (31), one = _mm512_set1_epi32 (1);
+  for (k = 0; k < n; k += 16) {
+    const __mmask16 live = (n - k >= 16? 0xffff : (__mmask16)((1u << (n - k)) - 1));
+    const __m512i j = _mm512_maskz_loadu_epi32 (live, &adj[k]);
+    const __m512i w = _mm512_mask_i32gather_epi32 (_mm512_setzero_si512 (), live,
+						   _mm512_srli_epi32 (j, 5), past, 4);
+    const __mmask16 hit = _mm512_mask_test_epi32_mask (live, _mm512_srlv_epi32 (w, _mm512_and_si512 (j, lowbits)), one);
+    if (hit) return k + __builtin_ctz (hit);
+  }
+#else
+  const __m512i lowbits = _mm512_set1_epi64 (63), one = _mm512_set1_epi64 (1);
+  for (k = 0; k < n; k += 8) {
+    const __mmask8 live = (n - k >= 8? 0xff : (__mmask8)((1u << (n - k)) - 1));
+    const __m512i j = _mm512_maskz_loadu_epi64 (live, &adj[k]);
+    const __m512i w = _mm512_mask_i64gather_epi64 (_mm512_setzero_si512 (), live,
+						   _mm512_srli_epi64 (j, 6), past, 8);
+    const __mmask8 hit = _mm512_mask_test_epi64_mask (live, _mm512_srlv_epi64 (w, _mm512_and_si512 (j, lowbits)), one);
+    if (hit) return k + __builtin_ctz (hit);
+  }
+#endif
+  return n;
+}
+#endif
+
+/* Probe accounting for NUMA mode: probes of neighbors inside
+   [lo, lo+n) count as local.  swept counts the bitmap words swept. */
+struct bu_probe { int64_t lo, n, local, remote, swept; };
+
+/* Mark the vertices found in word w visited and in the next
+   frontier, and return their number.  Each word is listed in one
+   chunk only (see struct bu_todo), so w belongs to the calling
+   thread. */
+static inline int64_t
+bu_wake (uint64_t * restrict seen, bitmap_t *next, int64_t w,
+	 uint64_t found)
+{
+  if (!found) return 0;
+  seen[w] |= found;
+  next->start[w] |= found;
+  return bm_word_popcount (found);
+}
+
+/* Bottom-up over the live vertices clear in seen within the *len
+   bitmap words listed in word.  The words still holding such vertices
+   afterwards are packed to the front of word and counted in *len.
+   The vertices woken are counted in out, with their degrees, so the
+   next frontier needs no pass of its own.  With kb or ke set, only
+   list positions [kb[i], ke[i]) are scanned, see bu_seg_bounds.
+   Instantiated once per ISA level with the matching scan, with and
+   without segment bounds. */
+ISA_INLINE void
+bu_sweep_body (int64_t * restrict word, int64_t *len,
+	       const uint64_t * restrict live, vid_t * restrict bfs_tree,
+	       uint64_t * restrict seen,
+	       const uint64_t * restrict past, bitmap_t *next,
+	       struct bu_probe *probe, struct frontier_cursor *out,
+	       const uint32_t * restrict kb, const uint32_t * restrict ke,
+	       int64_t (*scan) (const vid_t * restrict, int64_t,
+				const uint64_t * restrict))
+{
+  const int64_t nw = *len;
+  int64_t iw, keep = 0, size = 0, edges = 0, maxdeg = 0;
+  for (iw = 0; iw < nw; ++iw) {
+    const int64_t w = word[iw];
+    const uint64_t todo = live[w] & ~seen[w];
+    uint64_t left, found = 0;
+    for (left = todo; left; left &= left - 1) {
+      const int64_t i = 64*w + bm_word_ctz (left);
+      const int64_t n = XENDOFF(i) - XOFF(i);
+      const int64_t k0 = (kb? kb[i] : 0), k1 = (ke? ke[i] : n);
+      const vid_t * restrict adj = &xadj[XOFF(i) + k0];
+      const int64_t h = (k1 - k0 <= VC_TINY? bu_scan_scalar (adj, k1 - k0, past)
+			 : scan (adj, k1 - k0, past));
+      if (probe) {
+	const int64_t nprobe = (h < k1 - k0? h+1 : k1 - k0);
+	int64_t k;
+	for (k = 0; k < nprobe; ++k) {
+	  if ((uint64_t)(adj[k] - probe->lo) < (uint64_t)probe->n) ++probe->local;
+	  else ++probe->remote;
+	}
+      }
+      if (h < k1 - k0) {
+	bfs_tree[i] = adj[h];
+	found |= BM_BIT(i);
+	edges += n;
+	if (n > maxdeg) maxdeg = n;
+      }
+    }
+    size += bu_wake (seen, next, w, found);
+    if (todo & ~found) word[keep++] = w;
+  }
+  *len = keep;
+  out->size += size;
+  out->edges += edges;
+  if (maxdeg > out->maxdeg) out->maxdeg = maxdeg;
+}
+
+typedef void (*bu_sweep_fn) (int64_t * restrict, int64_t *,
+			     const uint64_t * restrict, vid_t * restrict,
+			     uint64_t * restrict,
+			     const uint64_t * restrict, bitmap_t *,
+			     struct bu_probe *, struct frontier_cursor *);
+typedef void (*bu_seg_fn) (int64_t * restrict, int64_t *,
+			   const uint64_t * restrict, vid_t * restrict,
+			   uint64_t * restrict,
+			   const uint64_t * restrict, bitmap_t *,
+			   struct bu_probe *, struct frontier_cursor *,
+			   const uint32_t * restrict, const uint32_t * restrict);
+
+#define BU_SWEEP_FNS(SUFFIX, TARGET)					\
+  TARGET static void							\
+  bu_sweep_##SUFFIX (int64_t * restrict word, int64_t *len,		\
+		     const uint64_t * restrict live,			\
+		     vid_t * restrict bfs_tree, uint64_t * restrict seen, \
+		     const uint64_t * restrict past, bitmap_t *next,	\
+		     struct bu_probe *probe, struct frontier_cursor *out) \
+  {									\
+    bu_sweep_body (word, len, live, bfs_tree, seen, past, next, probe, \
+		   out, NULL, NULL, bu_scan_##SUFFIX);			\
+  }									\
+  TARGET static void							\
+  bu_seg_##SUFFIX (int64_t * restrict word, int64_t *len,		\
+		   const uint64_t * restrict live,			\
+		   vid_t * restrict bfs_tree, uint64_t * restrict seen,	\
+		   const uint64_t * restrict past, bitmap_t *next,	\
+		   struct bu_probe *probe, struct frontier_cursor *out,	\
+		   const uint32_t * restrict kb, const uint32_t * restrict ke) \
+  {									\
+    bu_sweep_body (word, len, live, bfs_tree, seen, past, next, probe, \
+		   out, kb, ke, bu_scan_##SUFFIX);			\
+  }
+
+/* Sweeps with and without segment bounds at each ISA level. */
+BU_SWEEP_FNS(scalar, )
+#if defined(HAVE_ISA_X86)
+BU_SWEEP_FNS(avx2, ISA_TARGET("avx2"))
+BU_SWEEP_FNS(avx512, ISA_TARGET("avx512f"))
+#endif
+#undef BU_SWEEP_FNS
+
+/* Bottom-up over a compressed graph, decoding each list only as far
+   as its first visited neighbor. */
+static void
+bu_sweep_cadj (int64_t * restrict word, int64_t *len,
+	       const uint64_t * restrict live, vid_t * restrict bfs_tree,
+	       uint64_t * restrict seen, const uint64_t * restrict past,
+	       bitmap_t *next, struct bu_probe *probe,
+	       struct frontier_cursor *out)
+{
+  const int64_t nw = *len;
+  int64_t iw, keep = 0, size = 0, edges = 0, maxdeg = 0;
+  for (iw = 0; iw < nw; ++iw) {
+    const int64_t w = word[iw];
+    const uint64_t todo = live[w] & ~seen[w];
+    uint64_t left, found = 0;
+    for (left = todo; left; left &= left - 1) {
+      const int64_t i = 64*w + bm_word_ctz (left);
+      const int64_t n = XENDOFF(i) - XOFF(i);
+      const uint8_t *p = cadj_list (i, n);
+      vid_t j = i;
+      int64_t k;
+      for (k = 0; k < n; ++k) {
+	j = cadj_next (&p, k, i, j);
+	if (probe) {
+	  if ((uint64_t)(j - probe->lo) < (uint64_t)probe->n) ++probe->local;
+	  else ++probe->remote;
+	}
+	if (past[WORD_OFFSET(j)] & BM_BIT(j)) {
+	  bfs_tree[i] = j;
+	  found |= BM_BIT(i);
+	  edges += n;
+	  if (n > maxdeg) maxdeg = n;
+	  break;
+	}
+      }
+    }
+    size += bu_wake (seen, next, w, found);
+    if (todo & ~found) word[keep++] = w;
+  }
+  *len = keep;
+  out->size += size;
+  out->edges += edges;
+  if (maxdeg > out->maxdeg) out->maxdeg = maxdeg;
+}
+
+static const isa_fn bu_sweep_impl[ISA_NLEVEL] = {
+  (isa_fn)bu_sweep_scalar,
+#if defined(HAVE_ISA_X86)
+  (isa_fn)bu_sweep_avx2,
+  (isa_fn)bu_sweep_avx512,
+#endif
+};
+
+static const isa_fn bu_seg_impl[ISA_NLEVEL] = {
+  (isa_fn)bu_seg_scalar,
+#if defined(HAVE_ISA_X86)
+  (isa_fn)bu_seg_avx2,
+  (isa_fn)bu_seg_avx512,
+#endif
+};
+
+static bu_sweep_fn bu_sweep = bu_sweep_scalar;
+static bu_seg_fn bu_seg = bu_seg_scalar;
+
+static void
+select_kernels (void)
+{
+  int lvl;
+  if (cadj) {
+    bu_sweep = bu_sweep_cadj;
+    report_result ("bottom_up_isa: %s", isa_name (ISA_SCALAR));
+    return;
+  }
+  bu_sweep = (bu_sweep_fn)isa_select (bu_sweep_impl, &lvl);
+  bu_seg = (bu_seg_fn)isa_select (bu_seg_impl, &lvl);
+  report_result ("bottom_up_isa: %s", isa_name (lvl));
+}
+
+/* Bottom-up candidates.  live marks the vertices with neighbors, the
+   only ones a bottom-up step can wake.  word lists the bitmap words
+   that may still hold unvisited live vertices, in chunks of BU_WORDS:
+   chunk c lists len[c] words from word[c*BU_WORDS].  The first step of
+   a bottom-up phase refills every chunk with all of its words, and
+   each step keeps only the words it leaves with candidates, so late
+   steps touch little beyond the vertices still unvisited. */
+#define BU_CHUNK 1024
+#define BU_WORDS (BU_CHUNK / 64)
+
+struct bu_todo {
+  uint64_t * restrict live;
+  int64_t * restrict word;
+  int64_t * restrict len;
+  int64_t nchunk;
+};
+
+/* Sweep chunk c of todo over the neighbors in segment seg. */
+static void
+bu_chunk (struct bu_todo *todo, int64_t c, int fresh, int64_t seg,
+	  vid_t *bfs_tree, bitmap_t *seen, bitmap_t *past, bitmap_t *next,
+	  struct bu_probe *probe, struct frontier_cursor *out)
+{
+  int64_t * restrict word = &todo->word[c * BU_WORDS];
+
+  if (fresh && !seg) {
+    const int64_t w0 = c * BU_WORDS, nw = (nv + 63) / 64;
+    const int64_t n = (w0 + BU_WORDS < nw? BU_WORDS : nw - w0);
+    for (int64_t k = 0; k < n; ++k)
+      word[k] = w0 + k;
+    todo->len[c] = n;
+  }
+  if (probe) probe->swept += todo->len[c];
+  if (bu_nseg > 1)
+    bu_seg (word, &todo->len[c], todo->live, bfs_tree, seen->start,
+	    past->start, next, probe, out,
+	    (seg? &segpos[(seg-1)*nv] : NULL),
+	    (seg+1 < bu_nseg? &segpos[seg*nv] : NULL));
+  else
+    bu_sweep (word, &todo->len[c], todo->live, bfs_tree, seen->start,
+	      past->start, next, probe, out);
+}
+
+/* First chunk starting in NUMA slice p. */
+static inline int64_t
+bu_part_chunk (int p)
+{
+  return (part_word[p] + BU_WORDS - 1) / BU_WORDS;
+}
+
+/* Start the next segment's sweep once every thread is done with the
+   last one. */
+static void
+bu_next_segment (void)
+{
+  OMP("omp barrier");
+  if (npart > 1)
+    OMP("omp single")
+      for (int p = 0; p < npart; ++p)
+	part_next[p*NUMA_PAD] = bu_part_chunk (p);
+}
+
+/* Level tracing (see bfstrace.h).  Each step stores the calling
+   thread's time up to its closing barrier in trace_busy and the edges
+   it examined in trace_work, and adds those to trace_checked. */
+static double *trace_busy;
+static int64_t *trace_work;
+static int64_t trace_checked;
+
+/* Bottom-up sweep for NUMA mode.  Threads claim chunks of their own
+   node's slice first and steal from other slices once it is done.
+   Probes are classified by whether the neighbor's bitmap word lies
+   on the thread's node. */
+static void
+bfs_bottom_up_numa(vid_t *bfs_tree, bitmap_t *seen, bitmap_t *past,
+		   bitmap_t *next, struct bu_todo *todo, int fresh,
+		   struct frontier_cursor *out)
+{
+  const int home = thread_node ();
+  struct bu_probe probe;
+  int64_t nstolen = 0, seg;
+  int q;
+
+  probe.lo = part_lo[home];
+  probe.n = part_lo[home+1] - probe.lo;
+  probe.local = probe.remote = probe.swept = 0;
+  for (seg = 0; seg < bu_nseg; ++seg) {
+    if (seg) bu_next_segment ();
+    for (q = 0; q < npart; ++q) {
+      const int p = (home + q) % npart;
+      const int64_t ce = bu_part_chunk (p+1);
+      int64_t c;
+      while ((c = int64_fetch_add (&part_next[p*NUMA_PAD], 1)) < ce) {
+	const int64_t swept = probe.swept;
+	bu_chunk (todo, c, fresh, seg, bfs_tree, seen, past, next, &probe, out);
+	if (q) nstolen += probe.swept - swept;
+      }
+    }
+  }
+  int64_fetch_add (&numa_stats[home].vertices, 64 * probe.swept);
+  int64_fetch_add (&numa_stats[home].stolen, 64 * nstolen);
+  int64_fetch_add (&numa_stats[home].local_probes, probe.local);
+  int64_fetch_add (&numa_stats[home].remote_probes, probe.remote);
+  if (bfs_trace_on) {
+    trace_work[omp_get_thread_num ()] = probe.local + probe.remote;
+    int64_fetch_add (&trace_checked, probe.local + probe.remote);
+  }
+}
+
+/* One bottom-up level from past into next.  The vertices woken are
+   counted into nxt's size, edges and maxdeg as they are found; its
+   slots are filled by frontier_from_bitmap once the phase ends.  With
+   bottom-up segments the candidates are swept once per segment.
+   Returns the number woken. */
+static int64_t
+bfs_bottom_up_step(vid_t *bfs_tree, bitmap_t *seen, bitmap_t *past,
+		   bitmap_t *next, struct bu_todo *todo, int fresh,
+		   struct frontier *nxt)
+{
+  struct frontier_cursor out = FRONTIER_CURSOR_INIT;
+  const double t = (bfs_trace_on? timestamp () : 0);
+  OMP("omp single") {
+    bm_swap(past, next);
+  }
+  OMP("omp barrier");
+  bm_reset(next);
+  OMP("omp single") {
+    nxt->nchunk = nxt->size = nxt->edges = nxt->maxdeg = 0;
+    trace_checked = 0;
+    for (int p = 0; p < npart; ++p)
+      part_next[p*NUMA_PAD] = bu_part_chunk (p);
+  }
+  if (npart > 1)
+    bfs_bottom_up_numa(bfs_tree, seen, past, next, todo, fresh, &out);
+  else {
+    struct bu_probe probe = { 0, 0, 0, 0, 0 };
+    probe.n = nv;
+    for (int64_t seg = 0; seg < bu_nseg; ++seg) {
+      if (seg) bu_next_segment ();
+      OMP("omp for schedule(dynamic) nowait")
+	for (int64_t c = 0; c < todo->nchunk; ++c)
+	  bu_chunk (todo, c, fresh, seg, bfs_tree, seen, past, next,
+		    (bfs_trace_on? &probe : NULL), &out);
+    }
+    if (bfs_trace_on) {
+      trace_work[omp_get_thread_num ()] = probe.local;
+      int64_fetch_add (&trace_checked, probe.local);
+    }
+  }
+  frontier_flush (nxt, &out);
+  if (bfs_trace_on)
+    trace_busy[omp_get_thread_num ()] = timestamp () - t;
+  level_barrier ();
+  return nxt->size;
+}
+
+/* Claim j for parent v.  The visited bit is tested before the atomic
+   OR, so probes of visited neighbors read only the bitmap, and the
+   tree is written once per claimed vertex. */
+static inline int
+td_claim (vid_t * restrict bfs_tree, bitmap_t *seen, vid_t j, vid_t v)
+{
+  if (bm_set_bit_atomic (seen, j)) return 0;
+  bfs_tree[j] = v;
+  return 1;
+}
+
+/* Propagation-blocked top-down, enabled by BFS_TOP_DOWN=blocked.
+   Levels with at least TD_BLOCKED_EDGES frontier edges run in two
+   phases.  Threads first append a (child, parent) pair for each
+   unvisited neighbor to their own bin for the child's range of
+   2^shift vertices; then each bin is drained by one thread, which
+   claims its children with plain writes to its slice of seen and the
+   tree instead of atomics scattered over both.  A bin is a chain of
+   TD_BLOCK pairs from a shared pool, linked from the newest block, and
+   head and fill hold each thread's row of chain heads and fill counts
+   of the head blocks. */
+#define TD_BLOCK 256
+#define TD_MAX_BINS 256
+#define TD_MIN_SHIFT 16
+#define TD_BLOCKED_EDGES 65536
+
+struct td_pair { vid_t j, v; };
+
+struct td_bins {
+  struct td_pair * restrict pair; /* Length nblk_max*TD_BLOCK */
+  int64_t * restrict link; /* Length nblk_max */
+  int64_t * restrict head; /* Length nthreads*nbin */
+  int64_t * restrict fill; /* Length nthreads*nbin */
+  int64_t nblk, nblk_max, nbin;
+  int shift, ready;
+};
+
+/* The calling thread's row of bins. */
+struct td_binrow {
+  struct td_bins *bins;
+  int64_t * restrict head, * restrict fill;
+};
+
+static inline void
+td_bin (struct td_binrow *row, vid_t j, vid_t v)
+{
+  struct td_bins *bins = row->bins;
+  const int64_t b = j >> bins->shift;
+  int64_t k = row->fill[b];
+  if (k == TD_BLOCK) {
+    const int64_t blk = int64_fetch_add (&bins->nblk, 1);
+    assert (blk < bins->nblk_max);
+    bins->link[blk] = row->head[b];
+    row->head[b] = blk;
+    k = 0;
+  }
+  bins->pair[row->head[b] * TD_BLOCK + k].j = j;
+  bins->pair[row->head[b] * TD_BLOCK + k].v = v;
+  row->fill[b] = k+1;
+}
+
+/* Neighbors [k0, k1) of v in the top-down step, claimed directly or,
+   with row set, binned.  A compressed list is entered at the block
+   holding k0. */
+static inline void
+td_scan (vid_t * restrict bfs_tree, bitmap_t *seen, struct frontier *nxt,
+	 struct frontier_cursor *out, struct td_binrow *row, vid_t v,
+	 int64_t k0, int64_t k1)
+{
+  int64_t k;
+  if (cadj) {
+    const int64_t deg = XENDOFF(v) - XOFF(v), b = k0 / CADJ_BLOCK;
+    const uint8_t *p = cadj_list (v, deg);
+    vid_t j = v;
+    if (b) {
+      uint32_t off;
+      memcpy (&off, cadj + coff[v] + 4 * (b-1), sizeof (off));
+      p += off;
+    }
+    for (k = b * CADJ_BLOCK; k < k1; ++k) {
+      j = cadj_next (&p, k, v, j);
+      if (k < k0) continue;
+      if (row) {
+	if (!bm_get_bit (seen, j)) td_bin (row, j, v);
+      } else if (td_claim (bfs_tree, seen, j, v))
+	frontier_push (nxt, out, j);
+    }
+    return;
+  }
+  if (row) {
+    for (k = XOFF(v) + k0; k < XOFF(v) + k1; ++k)
+      if (!bm_get_bit (seen, xadj[k])) td_bin (row, xadj[k], v);
+    return;
+  }
+  for (k = XOFF(v) + k0; k < XOFF(v) + k1; ++k) {
+    const vid_t j = xadj[k];
+    if (pf.nbr && k + pf.nbr < XOFF(v) + k1)
+      PREFETCH (&seen->start[WORD_OFFSET(xadj[k + pf.nbr])]);
+    if (td_claim (bfs_tree, seen, j, v))
+      frontier_push (nxt, out, j);
+  }
+}
+
+/* Prefetch for expanding slot[k] of a frontier chunk ending at
+   slot[n], see prefetch.h.  Compressed lists are decoded in order,
+   so only their heads are fetched. */
+static inline void
+td_prefetch (const vid_t * restrict slot, int64_t k, int64_t n,
+	     const bitmap_t *seen)
+{
+  if (k + pf.vtx < n)
+    PREFETCH (&xoff[slot[k + pf.vtx]]);
+  if (k + pf.vtx/2 < n) {
+    const vid_t u = slot[k + pf.vtx/2];
+    if (cadj) PREFETCH (&cadj[coff[u]]);
+    else PREFETCH (&xadj[XOFF(u)]);
+  }
+  if (!cadj && k + pf.vtx/4 < n) {
+    const vid_t u = slot[k + pf.vtx/4];
+    const int64_t e = (XENDOFF(u) - XOFF(u) < pf.nbr? XENDOFF(u) : XOFF(u) + pf.nbr);
+    for (int64_t i = XOFF(u); i < e; ++i)
+      PREFETCH (&seen->start[WORD_OFFSET(xadj[i])]);
+  }
+}
+
+/* Edge-balanced top-down.  When the frontier's largest list exceeds
+   1/TD_SKEW of a thread's share of its edges, vertex grains leave
+   that list's thread running long after the rest.  The frontier's
+   edges are then cut into about TD_PIECES ranges per thread, split
+   at any list position, and claimed dynamically.  An exclusive scan
+   of the grains' degree sums lets each range find its first vertex
+   by binary search. */
+#define TD_SKEW 2
+#define TD_PIECES 8
+#define TD_MIN_PIECE 256
+
+static int64_t
+td_pieces (vid_t * restrict bfs_tree, bitmap_t *seen,
+	   const struct frontier *cur, struct frontier *nxt,
+	   struct frontier_cursor *out, struct td_binrow *row)
+{
+  const int64_t ng = frontier_grains (cur);
+  int64_t * restrict gsum = cur->gsum;
+  static int64_t piece, npiece;
+  int64_t g, work = 0;
+
+  OMP("omp for")
+    for (g = 0; g < ng; ++g) {
+      int64_t k, ke, e = 0;
+      frontier_grain (cur, g, &k, &ke);
+      for (; k < ke; ++k)
+	e += XENDOFF(cur->slot[k]) - XOFF(cur->slot[k]);
+      gsum[g+1] = e;
+    }
+  OMP("omp single") {
+    gsum[0] = 0;
+    for (g = 0; g < ng; ++g)
+      gsum[g+1] += gsum[g];
+    piece = gsum[ng] / (TD_PIECES * omp_get_num_threads ()) + 1;
+    if (piece < TD_MIN_PIECE) piece = TD_MIN_PIECE;
+    npiece = (gsum[ng] + piece - 1) / piece;
+  }
+  OMP("omp for schedule(dynamic) nowait")
+    for (int64_t r = 0; r < npiece; ++r) {
+      const int64_t e0 = r * piece;
+      const int64_t e1 = (e0 + piece < gsum[ng]? e0 + piece : gsum[ng]);
+      int64_t lo = 0, hi = ng - 1, k, ke, pos;
+      while (lo < hi) {
+	const int64_t mid = (lo + hi + 1) / 2;
+	if (gsum[mid] <= e0) lo = mid;
+	else hi = mid - 1;
+      }
+      pos = gsum[lo];
+      frontier_grain (cur, lo, &k, &ke);
+      while (pos < e1) {
+	if (k == ke) {
+	  if (++lo == ng) break;
+	  frontier_grain (cur, lo, &k, &ke);
+	  continue;
+	}
+	const vid_t v = cur->slot[k++];
+	const int64_t deg = XENDOFF(v) - XOFF(v);
+	if (pos + deg > e0) {
+	  const int64_t a = (e0 > pos? e0 - pos : 0);
+	  const int64_t b = (e1 - pos < deg? e1 - pos : deg);
+	  td_scan (bfs_tree, seen, nxt, out, row, v, a, b);
+	  work += b - a;
+	}
+	pos += deg;
+      }
+    }
+  return work;
+}
+
+/* Hub lists, cut into pieces of VC_HUB_PIECE neighbors.  Threads
+   claim pieces in order from cur's counter and walk the hub list
+   forward to the claimed piece. */
+static int64_t
+td_hubs (vid_t * restrict bfs_tree, bitmap_t *seen,
+	 const struct frontier *cur, struct frontier *nxt,
+	 struct frontier_cursor *out, struct td_binrow *row)
+{
+  /* Only the claim counter of cur changes. */
+  int64_t *next = (int64_t*)&cur->hub_next;
+  int64_t h = 0, base = 0, r, work = 0;
+
+  while (1) {
+    r = int64_fetch_add (next, 1);
+    while (h < cur->nhub) {
+      const vid_t v = cur->hub[h];
+      const int64_t n = (XENDOFF(v) - XOFF(v) + VC_HUB_PIECE - 1) / VC_HUB_PIECE;
+      if (r < base + n) break;
+      base += n;
+      ++h;
+    }
+    if (h == cur->nhub) break;
+    {
+      const vid_t v = cur->hub[h];
+      const int64_t deg = XENDOFF(v) - XOFF(v);
+      const int64_t a = (r - base) * VC_HUB_PIECE;
+      const int64_t b = (a + VC_HUB_PIECE < deg? a + VC_HUB_PIECE : deg);
+      td_scan (bfs_tree, seen, nxt, out, row, v, a, b);
+      work += b - a;
+    }
+  }
+  return work;
+}
+
+/* Expand cur's lists into nxt, or into row's bins.  Hubs are split
+   into pieces first and the rest taken by grains; without a hub list,
+   a skewed frontier is cut up by td_pieces instead.  Returns the
+   edges the calling thread examined. */
+static int64_t
+td_expand (vid_t * restrict bfs_tree, bitmap_t *seen,
+	   const struct frontier *cur, struct frontier *nxt,
+	   struct frontier_cursor *out, struct td_binrow *row)
+{
+  const int nt = omp_get_num_threads ();
+  int64_t work = 0, maxlist = INT64_MAX;
+
+  if (nt > 1 && cur->nhub <= 0 && cur->maxdeg * TD_SKEW * nt > cur->edges)
+    return td_pieces (bfs_tree, seen, cur, nxt, out, row);
+  if (nt > 1 && cur->nhub > 0) {
+    work = td_hubs (bfs_tree, seen, cur, nxt, out, row);
+    maxlist = VC_HUB;
+  }
+  OMP("omp for schedule(dynamic) nowait")
+    for (int64_t g = 0; g < frontier_grains (cur); ++g) {
+      const int64_t c = g / FRONTIER_GPC;
+      const int64_t ce = c * FRONTIER_CHUNK + cur->len[c];
+      int64_t k, ke;
+      frontier_grain (cur, g, &k, &ke);
+      for (; k < ke; ++k) {
+	const vid_t v = cur->slot[k];
+	const int64_t deg = XENDOFF(v) - XOFF(v);
+	if (pf.vtx) td_prefetch (cur->slot, k, ce, seen);
+	if (deg >= maxlist) continue;
+	td_scan (bfs_tree, seen, nxt, out, row, v, 0, deg);
+	work += deg;
+      }
+    }
+  return work;
+}
+
+/* Make room for the pairs of a level over cur and empty every
+   thread's bins.  Called by all threads; false if the pool cannot
+   grow. */
+static int
+td_bins_start (struct td_bins *bins, const struct frontier *cur)
+{
+  const int nt = omp_get_num_threads ();
+  const int64_t row = omp_get_thread_num () * bins->nbin;
+
+  for (int64_t b = 0; b < bins->nbin; ++b) {
+    bins->head[row + b] = -1;
+    bins->fill[row + b] = TD_BLOCK;
+  }
+  OMP("omp single") {
+    const int64_t need = cur->edges / TD_BLOCK + nt * bins->nbin + 1;
+    bins->nblk = 0;
+    bins->ready = 1;
+    if (need > bins->nblk_max) {
+      if (bins->pair) xfree_large (bins->pair);
+      if (bins->link) xfree_large (bins->link);
+      bins->nblk_max = need + need / 2;
+      bins->pair = xmalloc_large_ext (bins->nblk_max * TD_BLOCK * sizeof (*bins->pair));
+      bins->link = xmalloc_large_ext (bins->nblk_max * sizeof (*bins->link));
+      if (!bins->pair || !bins->link) {
+	if (bins->pair) xfree_large (bins->pair);
+	if (bins->link) xfree_large (bins->link);
+	bins->pair = NULL;
+	bins->link = NULL;
+	bins->nblk_max = 0;
+	bins->ready = 0;
+      }
+    }
+  }
+  return bins->ready;
+}
+
+/* Bin the frontier's edges, then drain each bin in turn.  Bins cover
+   whole bitmap words, so the thread draining one owns its words of
+   seen. */
+static int64_t
+td_propagate (vid_t * restrict bfs_tree, bitmap_t *seen,
+	      const struct frontier *cur, struct frontier *nxt,
+	      struct frontier_cursor *out, struct td_bins *bins)
+{
+  const int nt = omp_get_num_threads ();
+  const int64_t nbin = bins->nbin;
+  struct td_binrow row;
+  int64_t work = 0;
+
+  row.bins = bins;
+  row.head = &bins->head[omp_get_thread_num () * nbin];
+  row.fill = &bins->fill[omp_get_thread_num () * nbin];
+  work = td_expand (bfs_tree, seen, cur, nxt, out, &row);
+  OMP("omp barrier");
+  OMP("omp for schedule(dynamic) nowait")
+    for (int64_t b = 0; b < nbin; ++b)
+      for (int t = 0; t < nt; ++t) {
+	int64_t blk = bins->head[t * nbin + b], n = bins->fill[t * nbin + b];
+	for (; blk >= 0; blk = bins->link[blk], n = TD_BLOCK) {
+	  const struct td_pair * restrict pair = &bins->pair[blk * TD_BLOCK];
+	  for (int64_t k = 0; k < n; ++k) {
+	    const vid_t j = pair[k].j;
+	    if (bm_get_bit (seen, j)) continue;
+	    bm_set_bit (seen, j);
+	    bfs_tree[j] = pair[k].v;
+	    frontier_push (nxt, out, j);
+	  }
+	}
+      }
+  return work;
+}
+
+/* One top-down level.  With bins, large levels are propagation
+   blocked. */
+static void
+bfs_top_down_step(vid_t *bfs_tree, bitmap_t *seen,
+		  const struct frontier *cur, struct frontier *nxt,
+		  struct td_bins *bins)
+{
+  struct frontier_cursor out = FRONTIER_CURSOR_INIT;
+  const double t = (bfs_trace_on? timestamp () : 0);
+  int64_t work;
+
+  frontier_reset (nxt);
+  if (bins && cur->edges >= TD_BLOCKED_EDGES && td_bins_start (bins, cur))
+    work = td_propagate (bfs_tree, seen, cur, nxt, &out, bins);
+  else
+    work = td_expand (bfs_tree, seen, cur, nxt, &out, NULL);
+  frontier_flush (nxt, &out);
+  if (bfs_trace_on) {
+    trace_busy[omp_get_thread_num ()] = timestamp () - t;
+    trace_work[omp_get_thread_num ()] = work;
+  }
+  level_barrier ();
+}
+
+/* A top-down level on the calling thread alone, with no barriers, for
+   frontiers too small to share out. */
+static void
+td_serial_step (vid_t *bfs_tree, bitmap_t *seen,
+		const struct frontier *cur, struct frontier *nxt)
+{
+  struct frontier_cursor out = FRONTIER_CURSOR_INIT;
+  int64_t c, k;
+
+  nxt->nchunk = nxt->size = nxt->edges = nxt->maxdeg = 0;
+  nxt->nhub = nxt->hub_next = 0;
+  for (c = 0; c < cur->nchunk; ++c)
+    for (k = c * FRONTIER_CHUNK; k < c * FRONTIER_CHUNK + cur->len[c]; ++k) {
+      const vid_t v = cur->slot[k];
+      if (pf.vtx)
+	td_prefetch (cur->slot, k, c * FRONTIER_CHUNK + cur->len[c], seen);
+      td_scan (bfs_tree, seen, nxt, &out, NULL, v, 0, XENDOFF(v) - XOFF(v));
+    }
+  frontier_flush (nxt, &out);
+}
+
+static void
+trace_record (int dir, int64_t frontier, int64_t scout, int64_t checked,
+	      int64_t awake, double t0)
+{
+  struct bfs_trace_level lvl;
+  lvl.dir = dir;
+  lvl.frontier = frontier;
+  lvl.scout = scout;
+  lvl.checked = checked;
+  lvl.awake = awake;
+  lvl.time = timestamp () - t0;
+  bfs_trace_level (&lvl, trace_busy, trace_work, omp_get_num_threads ());
+}
+
+/* Record a finished level.  Called by all threads; the master's
+   record completes before the next step's first barrier, so no
+   thread overwrites trace_busy while it is read. */
+static void
+trace_level (int dir, int64_t frontier, int64_t scout, int64_t checked,
+	     int64_t awake, double t0)
+{
+  OMP("omp master")
+    trace_record (dir, frontier, scout, checked, awake, t0);
+}
+
+/* Search workspace.  tree is the BFS tree in internal IDs and out the
+   caller's view of it in original IDs, the same array when vid_t is
+   int64_t and there is no relabeling.  seen marks the visited
+   vertices for both directions; tree is only valid where it is set.
+   While a search stays top-down
+   and small, its vertices are logged, and the next search resets only
+   those; past WS_LOG_FRAC of the vertices it is dense, and tree and
+   out are rewritten whole. */
+#define WS_LOG_FRAC 16
+
+struct bfs_workspace {
+  struct frontier queue[2];
+  bitmap_t seen, past, next;
+  struct bu_todo todo;
+  struct td_bins bins;
+  vid_t * restrict tree;
+  int64_t *out;
+  vid_t * restrict log;
+  int64_t nlog, maxlog;
+  int dense, out_dirty;
+  double *busy;
+  int64_t *work;
+};
+
+#define OLD_ID(x) (perm_old? (int64_t)perm_old[x] : (int64_t)(x))
+
+void
+destroy_bfs_workspace (struct bfs_workspace *ws)
+{
+  if (!ws) return;
+  if (ws->tree && ws->tree != (vid_t*)ws->out) xfree_large (ws->tree);
+  if (ws->out) xfree_large (ws->out);
+  if (ws->log) xfree_large (ws->log);
+  if (ws->todo.word) xfree_large (ws->todo.word);
+  if (ws->todo.live) xfree_large (ws->todo.live);
+  free (ws->todo.len);
+  if (ws->bins.pair) xfree_large (ws->bins.pair);
+  if (ws->bins.link) xfree_large (ws->bins.link);
+  free (ws->bins.fill);
+  free (ws->bins.head);
+  if (ws->queue[1].slot) frontier_free (&ws->queue[1]);
+  if (ws->queue[0].slot) frontier_free (&ws->queue[0]);
+  bm_free (&ws->next);
+  bm_free (&ws->past);
+  bm_free (&ws->seen);
+  free (ws->work);
+  free (ws->busy);
+  free (ws);
+}
+
+/* Allocate todo and fill in live, which holds for the graph. */
+static void
+bu_todo_alloc (struct bu_todo *todo)
+{
+  const int64_t nw = (nv + 63) / 64;
+
+  todo->nchunk = (nw + BU_WORDS - 1) / BU_WORDS;
+  todo->live = xmalloc_large (nw * sizeof (*todo->live));
+  todo->word = xmalloc_large (todo->nchunk * BU_WORDS * sizeof (*todo->word));
+  todo->len = xmalloc (todo->nchunk * sizeof (*todo->len));
+  numa_place (todo->live, sizeof (*todo->live), part_word);
+  numa_place (todo->word, sizeof (*todo->word), part_word);
+  OMP("omp parallel for")
+    for (int64_t w = 0; w < nw; ++w) {
+      uint64_t b = 0;
+      for (int64_t k = 64*w; k < nv && k < 64*(w+1); ++k)
+	if (XENDOFF(k) > XOFF(k)) b |= BM_BIT(k);
+      todo->live[w] = b;
+    }
+}
+
+/* Size the bins; the pool grows with the levels, see td_bins_start. */
+static void
+td_bins_alloc (struct td_bins *bins)
+{
+  bins->shift = TD_MIN_SHIFT;
+  while (((nv - 1) >> bins->shift) + 1 > TD_MAX_BINS)
+    ++bins->shift;
+  bins->nbin = ((nv - 1) >> bins->shift) + 1;
+  bins->head = xmalloc (omp_get_max_threads () * bins->nbin * sizeof (*bins->head));
+  bins->fill = xmalloc (omp_get_max_threads () * bins->nbin * sizeof (*bins->fill));
+}
+
+struct bfs_workspace *
+create_bfs_workspace (void)
+{
+  struct bfs_workspace *ws = calloc (1, sizeof (*ws));
+
+  if (!ws) return NULL;
+  if (bm_alloc (&ws->seen, nv) || bm_alloc (&ws->past, nv)
+      || bm_alloc (&ws->next, nv)) {
+    destroy_bfs_workspace (ws);
+    return NULL;
+  }
+  frontier_alloc (&ws->queue[0]);
+  frontier_alloc (&ws->queue[1]);
+  /* Without a relabeling the tree lives in the front of out and
+     ws_copy_out widens it in place. */
+  ws->out = xmalloc_large (nv * sizeof (*ws->out));
+  ws->tree = (perm_new? xmalloc_large (nv * sizeof (*ws->tree)) : (vid_t*)ws->out);
+  ws->maxlog = nv / WS_LOG_FRAC + 1;
+  ws->log = xmalloc_large (ws->maxlog * sizeof (*ws->log));
+  bu_todo_alloc (&ws->todo);
+  if (td_blocking) td_bins_alloc (&ws->bins);
+  ws->busy = xmalloc (omp_get_max_threads () * sizeof (*ws->busy));
+  ws->work = xmalloc (omp_get_max_threads () * sizeof (*ws->work));
+
+  /* Pages go where the searches will touch them; the first search
+     then clears everything. */
+  numa_place (ws->tree, sizeof (*ws->tree), part_lo);
+  numa_place (ws->seen.start, sizeof (*ws->seen.start), part_word);
+  numa_place (ws->past.start, sizeof (*ws->past.start), part_word);
+  numa_place (ws->next.start, sizeof (*ws->next.start), part_word);
+  ws->dense = ws->out_dirty = 1;
+  return ws;
+}
+
+/* Undo the last search, except at srcvtx in tree, which is already
+   set.  Called by all threads; ends with a barrier. */
+static void
+ws_reset (struct bfs_workspace *ws, int64_t srcvtx)
+{
+  vid_t * restrict tree = ws->tree;
+  int64_t *out = ws->out;
+  int64_t k, kb, ke;
+
+  if (ws->dense) {
+    for (int p = 0; p < npart; ++p) {
+      numa_share (p, part_lo, &kb, &ke);
+      for (k = kb; k < ke && k < srcvtx; ++k)
+	tree[k] = -1;
+      for (k = (kb > srcvtx? kb : srcvtx+1); k < ke; ++k)
+	tree[k] = -1;
+      numa_share (p, part_word, &kb, &ke);
+      for (k = kb; k < ke; ++k)
+	ws->seen.start[k] = ws->next.start[k] = 0;
+    }
+  } else {
+    OMP("omp for nowait")
+      for (k = 0; k < ws->nlog; ++k) {
+	const vid_t v = ws->log[k];
+	if (out != (int64_t*)tree)
+	  out[OLD_ID(v)] = -1;
+	if (v != srcvtx)
+	  tree[v] = -1;
+	ws->seen.start[WORD_OFFSET(v)] = 0;
+      }
+  }
+  OMP("omp barrier");
+}
+
+/* Append a top-down level's output to the log, or give up on it. */
+static void
+ws_log_append (struct bfs_workspace *ws, const struct frontier *fr)
+{
+  if (!ws->dense && ws->nlog + fr->size > ws->maxlog)
+    ws->dense = 1;
+  if (!ws->dense)
+    for (int64_t c = 0; c < fr->nchunk; ++c)
+      for (int64_t k = 0; k < fr->len[c]; ++k)
+	ws->log[ws->nlog++] = fr->slot[c * FRONTIER_CHUNK + k];
+}
+
+/* Called by all threads; ends with a barrier. */
+static void
+ws_log (struct bfs_workspace *ws, const struct frontier *fr)
+{
+  OMP("omp single nowait")
+    ws_log_append (ws, fr);
+  level_barrier ();
+}
+
+/* Top-down levels from *cur on the calling thread, for as long as
+   they stay below bfs_serial_edges and top-down, swapping *cur and
+   *nxt after each as the parallel loop does. */
+static void
+ws_serial_levels (struct bfs_workspace *ws, struct frontier **cur,
+		  struct frontier **nxt, int64_t *scout_count,
+		  int64_t *edges_to_check)
+{
+  const int nt = omp_get_num_threads ();
+  struct frontier *t;
+
+  do {
+    const double t0 = (bfs_trace_on? timestamp () : 0);
+    td_serial_step (ws->tree, &ws->seen, *cur, *nxt);
+    ws_log_append (ws, *nxt);
+    *edges_to_check -= *scout_count;
+    if (bfs_trace_on) {
+      for (int k = 0; k < nt; ++k)
+	trace_busy[k] = trace_work[k] = 0;
+      trace_busy[omp_get_thread_num ()] = timestamp () - t0;
+      trace_work[omp_get_thread_num ()] = *scout_count;
+      trace_record (BFS_TRACE_TOP_DOWN, (*cur)->size, *scout_count,
+		    *scout_count, (*nxt)->size, t0);
+    }
+    t = *cur; *cur = *nxt; *nxt = t;
+    *scout_count = (*cur)->edges;
+  } while ((*cur)->size && *scout_count < bfs_serial_edges
+	   && *scout_count < ((*edges_to_check - *scout_count)/bfs_alpha));
+}
+
+/* Translate tree into out: whole after a dense search, otherwise the
+   logged vertices into an out that is -1 everywhere else.  A narrow
+   tree in the front of out is widened in place, each round moving
+   the upper half of the remaining entries, whose destinations lie
+   past every source not yet read; the next search then has to clear
+   the whole tree. */
+static void
+ws_copy_out (struct bfs_workspace *ws)
+{
+  const vid_t * restrict tree = ws->tree;
+  int64_t *out = ws->out;
+  int64_t k, hi = nv;
+
+  if (out == (int64_t*)tree) {
+    if (sizeof (vid_t) == sizeof (int64_t)) return;
+    OMP("omp parallel") {
+      int64_t lo, j;
+      while (hi > 1) {
+	lo = (hi+1)/2;
+	OMP("omp for")
+	  for (j = lo; j < hi; ++j)
+	    out[j] = tree[j];
+	OMP("omp single")
+	  hi = lo;
+      }
+    }
+    if (hi == 1)
+      out[0] = tree[0];
+    ws->dense = 1;
+    return;
+  }
+
+  if (ws->dense) {
+    OMP("omp parallel for")
+      for (k = 0; k < nv; ++k) {
+	const vid_t p = tree[perm_new? perm_new[k] : k];
+	out[k] = (p >= 0? OLD_ID(p) : -1);
+      }
+    ws->out_dirty = 1;
+    return;
+  }
+  if (ws->out_dirty) {
+    OMP("omp parallel for")
+      for (k = 0; k < nv; ++k)
+	out[k] = -1;
+    ws->out_dirty = 0;
+  }
+  OMP("omp parallel for")
+    for (k = 0; k < ws->nlog; ++k) {
+      const vid_t v = ws->log[k];
+      out[OLD_ID(v)] = OLD_ID(tree[v]);
+    }
+}
+
+int
+run_bfs_workspace (struct bfs_workspace *ws, int64_t srcvtx,
+		   int64_t **bfs_tree_out, int64_t *max_vtx_out)
+{
+  vid_t * restrict bfs_tree = ws->tree;
+  struct frontier *queue = ws->queue;
+  bitmap_t *seen = &ws->seen, *past = &ws->past, *next = &ws->next;
+  const int64_t down_cutoff = nv / bfs_beta;
+
+  *max_vtx_out = maxvtx;
+  *bfs_tree_out = ws->out;
+  if (perm_new)
+    srcvtx = perm_new[srcvtx];
+
+  queue[0].slot[0] = srcvtx;
+  queue[0].len[0] = 1;
+  queue[0].nchunk = queue[0].size = 1;
+  queue[0].edges = queue[0].maxdeg = XENDOFF(srcvtx) - XOFF(srcvtx);
+  queue[0].nhub = -1;
+  queue[1].nchunk = queue[1].size = queue[1].edges = queue[1].maxdeg = 0;
+  bfs_tree[srcvtx] = srcvtx;
+  trace_busy = ws->busy;
+  trace_work = ws->work;
+
+  struct frontier *serial_cur;
+  int64_t serial_scout, serial_edges;
+
+  OMP("omp parallel") {
+    struct frontier *cur = &queue[0], *nxt = &queue[1], *t;
+    int64_t awake_count = 1;
+    int64_t scout_count = cur->edges;
+    int64_t edges_to_check = XOFF(nv);
+
+    ws_reset (ws, srcvtx);
+    OMP("omp single") {
+      bm_set_bit (seen, srcvtx);
+      ws->log[0] = srcvtx;
+      ws->nlog = 1;
+      ws->dense = 0;
+    }
 
     while (awake_count != 0) {
+      double t0 = (bfs_trace_on? timestamp () : 0);
+      // Top-down, on the master alone while the levels are small
+      if (scout_count < ((edges_to_check - scout_count)/bfs_alpha)
+	  && scout_count < bfs_serial_edges) {
+	/* The master's levels rewrite both queues, which the others may
+	   not have read yet. */
+	level_barrier ();
+	OMP("omp master") {
+	  ws_serial_levels (ws, &cur, &nxt, &scout_count, &edges_to_check);
+	  serial_cur = cur;
+	  serial_scout = scout_count;
+	  serial_edges = edges_to_check;
+	}
+	level_barrier ();
+	cur = serial_cur;
+	nxt = (cur == &queue[0]? &queue[1] : &queue[0]);
+	awake_count = cur->size;
+	scout_count = serial_scout;
+	edges_to_check = serial_edges;
+	continue;
+      }
       // Top-down
-      if (scout_count < ((edges_to_check - scout_count)/ALPHA)) {
-	bfs_top_down_step(bfs_tree, vlist, nbuf, &k1, &k2);
+      if (scout_count < ((edges_to_check - scout_count)/bfs_alpha)) {
+	bfs_top_down_step(bfs_tree, seen, cur, nxt,
+			  (ws->bins.head? &ws->bins : NULL));
+	ws_log (ws, nxt);
 	edges_to_check -= scout_count;
-	awake_count = k2-k1;
+	if (bfs_trace_on)
+	  trace_level (BFS_TRACE_TOP_DOWN, awake_count, scout_count,
+		       scout_count, nxt->size, t0);
       // Bottom-up
       } else {
-	fill_bitmap_from_queue(&next, vlist, k1, k2);
+	int64_t frontier = awake_count;
+	int fresh = 1;
+	ws->dense = 1;
+	frontier_to_bitmap(cur, next);
 	do {
-	  awake_count = bfs_bottom_up_step(bfs_tree, &past, &next);
+	  const int64_t scout = scout_count;
+	  awake_count = bfs_bottom_up_step(bfs_tree, seen, past, next,
+					   &ws->todo, fresh, nxt);
+	  fresh = 0;
+	  edges_to_check -= scout;
+	  scout_count = nxt->edges;
+	  if (bfs_trace_on) {
+	    trace_level (BFS_TRACE_BOTTOM_UP, frontier, scout,
+			 trace_checked, awake_count, t0);
+	    frontier = awake_count;
+	    t0 = timestamp ();
+	  }
 	} while ((awake_count > down_cutoff));
-	fill_queue_from_bitmap(&next, vlist, &k1, &k2, nbuf);
-	OMP("omp barrier");
+	frontier_from_bitmap(nxt, next);
+      }
+      t = cur; cur = nxt; nxt = t;
+      awake_count = cur->size;
+      scout_count = cur->edges;
+    }
+  }
+
+  ws_copy_out (ws);
+  return 0;
+}
+
+int
+make_bfs_tree (int64_t *bfs_tree_out, int64_t *max_vtx_out,
+	       int64_t srcvtx)
+{
+  struct bfs_workspace *ws = create_bfs_workspace ();
+  int64_t *tree;
+  int err;
+
+  if (!ws) return -1;
+  if (!(err = run_bfs_workspace (ws, srcvtx, &tree, max_vtx_out)))
+    memcpy (bfs_tree_out, tree, nv * sizeof (*tree));
+  destroy_bfs_workspace (ws);
+  return err;
+}
+
+/* Batched search: up to 64 roots advance together, one bit per root
+   in per-vertex words (MS-BFS).  seen marks the roots that reached a
+   vertex, visit those for which it is in the current frontier.  A
+   level either pushes from frontier vertices, claiming bits with an
+   atomic OR, or pulls into vertices that some root has not reached
+   yet, stopping at the first neighbor for each missing root.  Parents
+   go straight into the callers' trees in original IDs. */
+
+static void
+batch_parents (int64_t **bfs_tree_out, uint64_t bits, int64_t w, int64_t v)
+{
+  const int64_t ow = OLD_ID(w), ov = OLD_ID(v);
+  while (bits) {
+    bfs_tree_out[bm_word_ctz (bits)][ow] = ov;
+    bits &= bits - 1;
+  }
+}
+
+int
+make_bfs_trees (int64_t **bfs_tree_out, int64_t *max_vtx_out,
+		const int64_t *srcvtx, int nroot)
+{
+  uint64_t * restrict seen, * restrict visit, * restrict claim;
+  const uint64_t live = (nroot < 64? ((uint64_t)1 << nroot) - 1 : ~(uint64_t)0);
+  const int64_t down_cutoff = nv / bfs_beta;
+  int64_t scout_count = 0, edges_to_check = XOFF(nv), active = 0;
+  int bottom_up = 0;
+
+  if (nroot < 1 || nroot > 64) return -1;
+  *max_vtx_out = maxvtx;
+
+  seen = xmalloc_large (3 * nv * sizeof (*seen));
+  if (!seen) return -1;
+  visit = seen + nv;
+  claim = visit + nv;
+  numa_place (seen, sizeof (*seen), part_lo);
+  numa_place (visit, sizeof (*visit), part_lo);
+  numa_place (claim, sizeof (*claim), part_lo);
+
+  OMP("omp parallel") {
+    int64_t k, kb, ke;
+    int p, r;
+
+    for (p = 0; p < npart; ++p) {
+      numa_share (p, part_lo, &kb, &ke);
+      for (k = kb; k < ke; ++k)
+	seen[k] = visit[k] = claim[k] = 0;
+    }
+    for (r = 0; r < nroot; ++r) {
+      OMP("omp for nowait")
+	for (k = 0; k < nv; ++k)
+	  bfs_tree_out[r][k] = -1;
+    }
+    OMP("omp barrier");
+    OMP("omp single") {
+      for (r = 0; r < nroot; ++r) {
+	const int64_t s = (perm_new? perm_new[srcvtx[r]] : srcvtx[r]);
+	bfs_tree_out[r][srcvtx[r]] = srcvtx[r];
+	if (!visit[s]) scout_count += XENDOFF(s) - XOFF(s);
+	seen[s] |= (uint64_t)1 << r;
+	visit[s] |= (uint64_t)1 << r;
+      }
+      active = 1;
+    }
+
+    /* The direction rules of run_bfs_workspace, with the vertices
+       some root reached standing for the awake count. */
+    while (active) {
+      if (!bottom_up
+	  && scout_count < ((edges_to_check - scout_count)/bfs_alpha)) {
+	OMP("omp for schedule(dynamic, 1024)")
+	  for (k = 0; k < nv; ++k) {
+	    const uint64_t vk = visit[k];
+	    const int64_t deg = XENDOFF(k) - XOFF(k);
+	    const uint8_t *cp;
+	    vid_t w = k;
+	    int64_t vo;
+	    if (!vk) continue;
+	    cp = (cadj? cadj_list (k, deg) : NULL);
+	    for (vo = 0; vo < deg; ++vo) {
+	      w = (cadj? cadj_next (&cp, vo, k, w) : xadj[XOFF(k) + vo]);
+	      const uint64_t d = vk & ~seen[w] & ~claim[w];
+	      if (d) {
+		const uint64_t got = d & ~(uint64_t)int64_fetch_or ((int64_t*)&claim[w], d);
+		batch_parents (bfs_tree_out, got, w, k);
+	      }
+	    }
+	  }
+	OMP("omp single")
+	  edges_to_check -= scout_count;
+      } else {
+	OMP("omp for schedule(dynamic, 1024)")
+	  for (k = 0; k < nv; ++k) {
+	    const uint64_t want = live & ~seen[k];
+	    const int64_t deg = XENDOFF(k) - XOFF(k);
+	    const uint8_t *cp;
+	    uint64_t got = 0;
+	    vid_t v = k;
+	    int64_t vo;
+	    if (!want) continue;
+	    cp = (cadj? cadj_list (k, deg) : NULL);
+	    for (vo = 0; vo < deg && got != want; ++vo) {
+	      v = (cadj? cadj_next (&cp, vo, k, v) : xadj[XOFF(k) + vo]);
+	      const uint64_t b = visit[v] & want & ~got;
+	      if (b) {
+		got |= b;
+		batch_parents (bfs_tree_out, b, k, v);
+	      }
+	    }
+	    claim[k] = got;
+	  }
+	OMP("omp single") {
+	  edges_to_check -= scout_count;
+	  bottom_up = 1;
+	}
       }
-      // Count the number of edges in the frontier
       OMP("omp single")
-	scout_count = 0;
-      OMP("omp for reduction(+ : scout_count)")
-      for (int64_t i=k1; i<k2; i++) {
-	int64_t v = vlist[i];
-	scout_count += XENDOFF(v) - XOFF(v);
+	active = scout_count = 0;
+      OMP("omp for reduction(+ : active, scout_count)")
+	for (k = 0; k < nv; ++k) {
+	  const uint64_t c = claim[k];
+	  visit[k] = c;
+	  if (c) {
+	    seen[k] |= c;
+	    claim[k] = 0;
+	    ++active;
+	    scout_count += XENDOFF(k) - XOFF(k);
+	  }
+	}
+      OMP("omp single")
+	if (active <= down_cutoff) bottom_up = 0;
+    }
+  }
+
+  xfree_large (seen);
+  return 0;
+}
+
+#undef OLD_ID
+
+/* Direction-switch tuning.  Profiles hold lines of
+     scale edgefactor threads alpha beta
+   with the graph shape derived from nv and the adjacency volume.
+   BFS_TUNE calibrates over a few roots and records the result in the
+   profile (BFS_PROFILE, default omp-csr.profile; empty disables it);
+   otherwise a matching profile line is loaded.  BFS_ALPHA and BFS_BETA
+   override either. */
+#define TUNE_NROOT 4
+static const int64_t tune_alpha[] = { 2, 4, 8, 14, 24, 48, 96 };
+static const int64_t tune_beta[] = { 6, 12, 24, 48, 96 };
+
+static void
+profile_key (int64_t *scale, int64_t *ef, int64_t *nthr)
+{
+  int64_t s = 0;
+  while (((int64_t)1 << s) < nv) ++s;
+  *scale = s;
+  *ef = (nedge_in + nv/2) / nv;
+  *nthr = omp_get_max_threads ();
+}
+
+static int
+profile_load (const char *path)
+{
+  FILE *f = fopen (path, "r");
+  char line[256];
+  int64_t key[3], v[5];
+  int found = 0;
+
+  if (!f) return 0;
+  profile_key (&key[0], &key[1], &key[2]);
+  while (fgets (line, sizeof (line), f))
+    if (5 == sscanf (line, "%" SCNd64 " %" SCNd64 " %" SCNd64 " %" SCNd64 " %" SCNd64,
+		     &v[0], &v[1], &v[2], &v[3], &v[4])
+	&& v[0] == key[0] && v[1] == key[1] && v[2] == key[2]
+	&& v[3] > 0 && v[4] > 0) {
+      bfs_alpha = v[3];
+      bfs_beta = v[4];
+      found = 1;
+    }
+  fclose (f);
+  return found;
+}
+
+/* Rewrite the profile with this shape's line replaced. */
+static void
+profile_save (const char *path)
+{
+  FILE *f;
+  char *old = NULL, line[256];
+  size_t len = 0, sz = 0;
+  int64_t key[3], v[3];
+
+  profile_key (&key[0], &key[1], &key[2]);
+  if ((f = fopen (path, "r"))) {
+    while (fgets (line, sizeof (line), f)) {
+      if (3 == sscanf (line, "%" SCNd64 " %" SCNd64 " %" SCNd64, &v[0], &v[1], &v[2])
+	  && v[0] == key[0] && v[1] == key[1] && v[2] == key[2])
+	continue;
+      if (len + strlen (line) + 1 > sz) {
+	char *grown = realloc (old, sz = 2 * sz + sizeof (line));
+	if (!grown) {
+	  fprintf (stderr, "Cannot read BFS profile %s.\n", path);
+	  free (old);
+	  fclose (f);
+	  return;
+	}
+	old = grown;
       }
+      strcpy (old + len, line);
+      len += strlen (line);
     }
+    fclose (f);
+  }
+  if (!(f = fopen (path, "w"))) {
+    fprintf (stderr, "Cannot write BFS profile %s.\n", path);
+    free (old);
+    return;
   }
+  if (len)
+    fputs (old, f);
+  else
+    fputs ("# scale edgefactor threads alpha beta\n", f);
+  fprintf (f, "%" PRId64 " %" PRId64 " %" PRId64 " %" PRId64 " %" PRId64 "\n",
+	   key[0], key[1], key[2], bfs_alpha, bfs_beta);
+  fclose (f);
+  free (old);
+}
+
+/* TUNE_NROOT roots with neighbors, see tune_roots, in the original
+   IDs run_bfs_workspace takes. */
+static int
+pick_roots (int64_t *root)
+{
+  int64_t k;
 
-  bm_free(&past);
-  bm_free(&next);
-  xfree_large (vlist);
+  if (tune_roots (nv, xoff, TUNE_NROOT, root)) {
+    fprintf (stderr, "No vertex has neighbors, not tuning.\n");
+    return -1;
+  }
+  if (perm_old)
+    for (k = 0; k < TUNE_NROOT; ++k)
+      root[k] = perm_old[root[k]];
+  return 0;
+}
 
-  return err;
+static double
+tune_time (struct bfs_workspace *ws, const int64_t *root)
+{
+  int64_t k, maxv, *tree;
+  double t = timestamp ();
+  for (k = 0; k < TUNE_NROOT; ++k)
+    run_bfs_workspace (ws, root[k], &tree, &maxv);
+  return timestamp () - t;
+}
+
+/* Coordinate search: alpha with the default beta, then beta. */
+static void
+tune_direction (void)
+{
+  struct bfs_workspace *ws;
+  int64_t root[TUNE_NROOT], k;
+  double t, best;
+
+  if (!(ws = create_bfs_workspace ())) {
+    fprintf (stderr, "Cannot allocate a BFS workspace, not tuning.\n");
+    return;
+  }
+  if (pick_roots (root)) {
+    destroy_bfs_workspace (ws);
+    return;
+  }
+
+  bfs_alpha = ALPHA;
+  bfs_beta = BETA;
+  best = tune_time (ws, root);
+  for (k = 0; k < sizeof (tune_alpha) / sizeof (*tune_alpha); ++k) {
+    const int64_t a = bfs_alpha;
+    if (tune_alpha[k] == ALPHA) continue;
+    bfs_alpha = tune_alpha[k];
+    if ((t = tune_time (ws, root)) < best) best = t;
+    else bfs_alpha = a;
+  }
+  for (k = 0; k < sizeof (tune_beta) / sizeof (*tune_beta); ++k) {
+    const int64_t b = bfs_beta;
+    if (tune_beta[k] == BETA) continue;
+    bfs_beta = tune_beta[k];
+    if ((t = tune_time (ws, root)) < best) best = t;
+    else bfs_beta = b;
+  }
+  destroy_bfs_workspace (ws);
+  memset (numa_stats, 0, sizeof (numa_stats));
+}
+
+struct prefetch_tune {
+  struct bfs_workspace *ws;
+  int64_t root[TUNE_NROOT];
+};
+
+static double
+prefetch_time (void *arg)
+{
+  struct prefetch_tune *pt = arg;
+  return tune_time (pt->ws, pt->root);
+}
+
+/* BFS_PREFETCH, see prefetch.h.  Tuning runs the searches with the
+   direction thresholds already chosen. */
+static void
+setup_prefetch (void)
+{
+  const char *s = getenv ("BFS_PREFETCH");
+  struct prefetch_tune pt;
+
+  if (!s || strcmp (s, "auto") || pick_roots (pt.root)
+      || !(pt.ws = create_bfs_workspace ())) {
+    prefetch_setup (&pf, NULL, NULL);
+    return;
+  }
+  prefetch_setup (&pf, prefetch_time, &pt);
+  destroy_bfs_workspace (pt.ws);
+  memset (numa_stats, 0, sizeof (numa_stats));
+}
+
+/* BFS_SERIAL_EDGES sets the out-edge count below which top-down
+   levels run on one thread (0 never), BFS_BARRIER the level barrier
+   (omp or spin), BFS_TOP_DOWN the kernel of large top-down levels
+   (queue or blocked). */
+static void
+setup_levels (void)
+{
+  const char *s = getenv ("BFS_BARRIER");
+  const char *td = getenv ("BFS_TOP_DOWN");
+
+  if (getenv ("BFS_SERIAL_EDGES") && atoll (getenv ("BFS_SERIAL_EDGES")) >= 0)
+    bfs_serial_edges = atoll (getenv ("BFS_SERIAL_EDGES"));
+  level_spin = 0;
+  if (s && !strcmp (s, "spin")) {
+#if defined(__GNUC__)||defined(__INTEL_COMPILER)
+    level_spin = 1;
+#else
+    fprintf (stderr, "No spin barrier in this build, using omp.\n");
+#endif
+  } else if (s && strcmp (s, "omp"))
+    fprintf (stderr, "Unknown BFS_BARRIER %s, using omp.\n", s);
+  td_blocking = (td && !strcmp (td, "blocked"));
+  if (td && !td_blocking && strcmp (td, "queue"))
+    fprintf (stderr, "Unknown BFS_TOP_DOWN %s, using queue.\n", td);
+  report_result ("bfs_serial_edges: %" PRId64, bfs_serial_edges);
+  report_result ("bfs_barrier: %s", (level_spin? "spin" : "omp"));
+  report_result ("bfs_top_down: %s", (td_blocking? "blocked" : "queue"));
+}
+
+static void
+setup_direction (void)
+{
+  const char *path = getenv ("BFS_PROFILE");
+  const char *src = "default";
+
+  if (!path) path = "omp-csr.profile";
+  if (getenv ("BFS_TUNE")) {
+    double t = timestamp ();
+    tune_direction ();
+    report_result ("bfs_tune_time: %20.17e", timestamp () - t);
+    if (*path) profile_save (path);
+    src = "tuned";
+  } else if (*path && profile_load (path))
+    src = "profile";
+  if (getenv ("BFS_ALPHA") && atoll (getenv ("BFS_ALPHA")) > 0) {
+    bfs_alpha = atoll (getenv ("BFS_ALPHA"));
+    src = "env";
+  }
+  if (getenv ("BFS_BETA") && atoll (getenv ("BFS_BETA")) > 0) {
+    bfs_beta = atoll (getenv ("BFS_BETA"));
+    src = "env";
+  }
+  report_result ("bfs_alpha: %" PRId64, bfs_alpha);
+  report_result ("bfs_beta: %" PRId64, bfs_beta);
+  report_result ("bfs_params: %s", src);
 }
 
 void
 destroy_graph (void)
 {
+  numa_report ();
   free_graph ();
 }
 
@@ -447,10 +3148,10 @@ int64_casval(int64_t* p, int64_t oldval, int64_t newval)
 {
   return __sync_val_compare_and_swap (p, oldval, newval);
 }
-int
-int64_cas(int64_t* p, int64_t oldval, int64_t newval)
+int64_t
+int64_fetch_or (int64_t* p, int64_t bits)
 {
-  return __sync_bool_compare_and_swap (p, oldval, newval);
+  return __sync_fetch_and_or (p, bits);
 }
 #else
 /* XXX: These are not correct, but suffice for the above uses. */
@@ -466,30 +3167,27 @@ int64_fetch_add (int64_t* p, int64_t incr)
   return t;
 }
 int64_t
-int64_casval(int64_t* p, int64_t oldval, int64_t newval)
+int64_fetch_or (int64_t* p, int64_t bits)
 {
-  int64_t v;
+  int64_t t;
   OMP("omp critical (CAS)") {
-    v = *p;
-    if (v == oldval)
-      *p = newval;
+    t = *p;
+    *p |= bits;
   }
   OMP("omp flush (p)");
-  return v;
+  return t;
 }
-int
-int64_cas(int64_t* p, int64_t oldval, int64_t newval)
+int64_t
+int64_casval(int64_t* p, int64_t oldval, int64_t newval)
 {
-  int out = 0;
+  int64_t v;
   OMP("omp critical (CAS)") {
-    int64_t v = *p;
-    if (v == oldval) {
+    v = *p;
+    if (v == oldval)
       *p = newval;
-      out = 1;
-    }
   }
   OMP("omp flush (p)");
-  return out;
+  return v;
 }
 #endif
 #else
@@ -501,6 +3199,13 @@ int64_fetch_add (int64_t* p, int64_t incr)
   return t;
 }
 int64_t
+int64_fetch_or (int64_t* p, int64_t bits)
+{
+  int64_t t = *p;
+  *p |= bits;
+  return t;
+}
+int64_t
 int64_casval(int64_t* p, int64_t oldval, int64_t newval)
 {
   int64_t v = *p;
@@ -508,15 +3213,4 @@ int64_casval(int64_t* p, int64_t oldval, int64_t newval)
     *p = newval;
   return v;
 }
-int
-int64_cas(int64_t* p, int64_t oldval, int64_t newval)
-{
-  int64_t v = *p;
-  int out = 0;
-  if (v == oldval) {
-    *p = newval;
-    out = 1;
-  }
-  return out;
-}
 #endif
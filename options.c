@@ -48,7 +48,7 @@ get_options (int argc, char **argv) {
   if (getenv ("VERBOSE"))
     VERBOSE = 1;
 
-  while ((c = getopt (argc, argv, "v?hRs:e:A:a:B:b:C:c:D:d:Vo:r:")) != -1)
+  while ((c = getopt (argc, argv, "v?hRs:e:A:a:B:b:C:c:D:d:Vo:r:X:")) != -1)
     switch (c) {
     case 'v':
       printf ("%s version %d\n", NAME, VERSION);
@@ -72,6 +72,8 @@ get_options (int argc, char **argv) {
 	      "  V   : Enable extra (Verbose) output\n"
 	      "  o   : Read the edge list from (or dump to) the named file\n"
 	      "  r   : Read the BFS roots from (or dump to) the named file\n"
+	      "  X   : KEY=VALUE, set the implementation parameter KEY as if\n"
+	      "        by the environment variable (e.g. -X BFS_ALPHA=10)\n"
 	      "\n"
 	      "Outputs take the form of \"key: value\", with keys:\n"
 	      "  SCALE\n"
@@ -124,6 +126,15 @@ get_options (int argc, char **argv) {
 	err = 1;
       }
       break;
+    case 'X':
+      {
+	char *kv = strdup (optarg);
+	if (!kv || !strchr (kv, '=') || kv[0] == '=' || putenv (kv)) {
+	  fprintf (stderr, "Cannot set parameter %s, expected KEY=VALUE.\n", optarg);
+	  err = -1;
+	}
+      }
+      break;
     case 's':
       errno = 0;
       SCALE = strtol (optarg, NULL, 10);
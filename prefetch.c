@@ -0,0 +1,71 @@
+/* -*- mode: C; mode: folding; fill-column: 70; -*- */
+/* See COPYING for license. */
+#include "compat.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "graph500.h"
+#include "timer.h"
+#include "prefetch.h"
+
+static const int64_t grid_vtx[] = { 8, 16, 32, 64 };
+static const int64_t grid_nbr[] = { 4, 8, 16 };
+
+/* Coordinate search from no prefetching: the vertex distance first,
+   then the neighbor distance.  A distance is kept only when it beats
+   the best time so far by 2%, so timing noise leaves
+   prefetching off.  The first run only warms the caches. */
+#define TUNE_MARGIN 0.98
+
+static void
+prefetch_tune (struct prefetch_dist *d, double (*run) (void *), void *arg)
+{
+  double best, t;
+  size_t k;
+
+  d->vtx = d->nbr = 0;
+  run (arg);
+  best = run (arg);
+  for (k = 0; k < sizeof (grid_vtx) / sizeof (*grid_vtx); ++k) {
+    const int64_t v = d->vtx;
+    d->vtx = grid_vtx[k];
+    if ((t = run (arg)) < TUNE_MARGIN * best) best = t;
+    else d->vtx = v;
+  }
+  for (k = 0; k < sizeof (grid_nbr) / sizeof (*grid_nbr); ++k) {
+    const int64_t n = d->nbr;
+    d->nbr = grid_nbr[k];
+    if ((t = run (arg)) < TUNE_MARGIN * best) best = t;
+    else d->nbr = n;
+  }
+}
+
+void
+prefetch_setup (struct prefetch_dist *d, double (*run) (void *), void *arg)
+{
+  const char *s = getenv ("BFS_PREFETCH");
+
+  d->vtx = d->nbr = 0;
+  if (s && !strcmp (s, "auto")) {
+    const double t = timestamp ();
+    if (!run) {
+      fprintf (stderr, "Cannot tune BFS_PREFETCH, not prefetching.\n");
+    } else {
+      prefetch_tune (d, run, arg);
+      report_result ("bfs_prefetch_tune_time: %20.17e", timestamp () - t);
+    }
+  } else if (s) {
+    char *end;
+    int64_t v = strtoll (s, &end, 10), n = v;
+    if (*end == ',')
+      n = strtoll (end + 1, &end, 10);
+    if (end == s || *end || v < 0 || n < 0)
+      fprintf (stderr, "Unknown BFS_PREFETCH %s, not prefetching.\n", s);
+    else {
+      d->vtx = v;
+      d->nbr = n;
+    }
+  }
+  report_result ("bfs_prefetch: %" PRId64 ",%" PRId64, d->vtx, d->nbr);
+}
@@ -0,0 +1,35 @@
+/* -*- mode: C; mode: folding; fill-column: 70; -*- */
+/* See COPYING for license. */
+#if !defined(PREFETCH_HEADER_)
+#define PREFETCH_HEADER_
+
+#include "compat.h"
+
+/* Software prefetch in the top-down kernels, set by BFS_PREFETCH.
+   While expanding frontier vertex k, a kernel prefetches the offsets
+   of vertex k+vtx, the head of vertex k+vtx/2's list, and the
+   per-vertex search state (tree entry or visited bit) of the first
+   nbr neighbors of vertex k+vtx/4.  Within a list it prefetches the
+   state of the neighbor nbr positions ahead.  A zero distance turns
+   its stages off; both are zero unless BFS_PREFETCH is set, since
+   the hardware prefetchers matched the software ones on the graphs
+   measured so far. */
+
+#if defined(__GNUC__)
+#define PREFETCH(p) __builtin_prefetch ((p))
+#else
+#define PREFETCH(p) ((void)0)
+#endif
+
+struct prefetch_dist { int64_t vtx, nbr; };
+
+/** Set d from BFS_PREFETCH: "V,N" or "V" fixes the distances, and
+    auto times run(arg) over a grid of distances and keeps the
+    fastest; unset or 0 disables prefetching.  run searches a fixed
+    set of roots with the distances in *d and returns the seconds
+    taken; NULL rules out tuning.  Reports bfs_prefetch and, when
+    tuned, bfs_prefetch_tune_time. */
+void prefetch_setup (struct prefetch_dist *d, double (*run) (void *),
+		     void *arg);
+
+#endif /* PREFETCH_HEADER_ */
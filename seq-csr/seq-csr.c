@@ -14,13 +14,28 @@
 #include "../graph500.h"
 #include "../xalloc.h"
 #include "../generator/graph_generator.h"
+#include "../timer.h"
+#include "../adjsort.h"
+#include "../bfstrace.h"
+#include "../csrsnap.h"
+#include "../prefetch.h"
+#include "../tune.h"
 
 #define MINVECT_SIZE 2
 
 static int64_t maxvtx, nv, sz;
-static int64_t * restrict xoff; /* Length 2*nv+2 */
-static int64_t * restrict xadjstore; /* Length MINVECT_SIZE + (xoff[nv] == nedge) */
-static int64_t * restrict xadj;
+static int64_t * restrict xoff; /* Length nv+1 */
+static int64_t * restrict xadj; /* Length xoff[nv] */
+
+/* Construction layout, see compact_graph: interleaved begin and end
+   offsets, lists padded to MINVECT_SIZE and holes left by
+   deduplication. */
+static int64_t * restrict bxoff; /* Length 2*nv+2 */
+static int64_t * restrict xadjstore; /* Length MINVECT_SIZE + BXOFF(nv) */
+static int64_t * restrict bxadj;
+
+static struct prefetch_dist pf;
+static void setup_prefetch (void);
 
 static void
 find_nv (const struct packed_edge * restrict IJ, const int64_t nedge)
@@ -40,49 +55,58 @@ find_nv (const struct packed_edge * restrict IJ, const int64_t nedge)
 static int
 alloc_graph (int64_t nedge)
 {
-  sz = (2*nv+2) * sizeof (*xoff);
-  xoff = xmalloc_large_ext (sz);
-  if (!xoff) return -1;
+  bxoff = xmalloc_large_ext ((2*nv+2) * sizeof (*bxoff));
+  if (!bxoff) return -1;
   return 0;
 }
 
+/* While snap.base is set, xoff and xadj point into a mapped snapshot,
+   see csrsnap.h. */
+static struct csr_snapshot snap;
+
 static void
 free_graph (void)
 {
-  xfree_large (xadjstore);
+  if (snap.base) {
+    csr_snapshot_unmap (&snap);
+    return;
+  }
+  xfree_large (xadj);
   xfree_large (xoff);
 }
 
-#define XOFF(k) (xoff[2*(k)])
-#define XENDOFF(k) (xoff[1+2*(k)])
+#define XOFF(k) (xoff[(k)])
+#define XENDOFF(k) (xoff[(k)+1])
+#define BXOFF(k) (bxoff[2*(k)])
+#define BXENDOFF(k) (bxoff[1+2*(k)])
 
 static int
 setup_deg_off (const struct packed_edge * restrict IJ, int64_t nedge)
 {
   int64_t k, accum;
   for (k = 0; k < 2*nv+2; ++k)
-    xoff[k] = 0;
+    bxoff[k] = 0;
   for (k = 0; k < nedge; ++k) {
     int64_t i = get_v0_from_edge(&IJ[k]);
     int64_t j = get_v1_from_edge(&IJ[k]);
     if (i != j) { /* Skip self-edges. */
-      if (i >= 0) ++XOFF(i);
-      if (j >= 0) ++XOFF(j);
+      if (i >= 0) ++BXOFF(i);
+      if (j >= 0) ++BXOFF(j);
     }
   }
   accum = 0;
   for (k = 0; k < nv; ++k) {
-    int64_t tmp = XOFF(k);
+    int64_t tmp = BXOFF(k);
     if (tmp < MINVECT_SIZE) tmp = MINVECT_SIZE;
-    XOFF(k) = accum;
+    BXOFF(k) = accum;
     accum += tmp;
   }
-  XOFF(nv) = accum;
+  BXOFF(nv) = accum;
   for (k = 0; k < nv; ++k)
-    XENDOFF(k) = XOFF(k);
+    BXENDOFF(k) = BXOFF(k);
   if (!(xadjstore = xmalloc_large_ext ((accum + MINVECT_SIZE) * sizeof (*xadjstore))))
     return -1;
-  xadj = &xadjstore[MINVECT_SIZE]; /* Cheat and permit xadj[-1] to work. */
+  bxadj = &xadjstore[MINVECT_SIZE]; /* Cheat and permit bxadj[-1] to work. */
   for (k = 0; k < accum + MINVECT_SIZE; ++k)
     xadjstore[k] = -1;
   return 0;
@@ -92,43 +116,21 @@ static void
 scatter_edge (const int64_t i, const int64_t j)
 {
   int64_t where;
-  where = XENDOFF(i)++;
-  xadj[where] = j;
-}
-
-static int
-i64cmp (const void *a, const void *b)
-{
-  const int64_t ia = *(const int64_t*)a;
-  const int64_t ib = *(const int64_t*)b;
-  if (ia < ib) return -1;
-  if (ia > ib) return 1;
-  return 0;
-}
-
-static void
-pack_vtx_edges (const int64_t i)
-{
-  int64_t kcur, k;
-  if (XOFF(i)+1 >= XENDOFF(i)) return;
-  qsort (&xadj[XOFF(i)], XENDOFF(i)-XOFF(i), sizeof(*xadj), i64cmp);
-  kcur = XOFF(i);
-  for (k = XOFF(i)+1; k < XENDOFF(i); ++k)
-    if (xadj[k] != xadj[kcur])
-      xadj[++kcur] = xadj[k];
-  ++kcur;
-  for (k = kcur; k < XENDOFF(i); ++k)
-    xadj[k] = -1;
-  XENDOFF(i) = kcur;
+  where = BXENDOFF(i)++;
+  bxadj[where] = j;
 }
 
+/* PACK_QSORT in the environment selects the old per-list qsort for
+   comparison. */
 static void
 pack_edges (void)
 {
-  int64_t v;
+  const int use_qsort = getenv ("PACK_QSORT") != NULL;
+  double t = timestamp ();
 
-  for (v = 0; v < nv; ++v)
-    pack_vtx_edges (v);
+  adjsort_pack_i64 (nv, bxoff, bxadj, use_qsort);
+  report_result ("pack_engine: %s", use_qsort? "qsort" : "adjsort");
+  report_result ("pack_time: %20.17e", timestamp () - t);
 }
 
 static void
@@ -148,19 +150,89 @@ gather_edges (const struct packed_edge * restrict IJ, int64_t nedge)
   pack_edges ();
 }
 
+/* Final layout.  Copy the lists out of the construction arrays into
+   a dense xadj indexed by a single nv+1 offset array, then free the
+   construction arrays. */
+static int
+compact_graph (void)
+{
+  const int64_t old_bytes = (2*nv+2) * (int64_t)sizeof (*bxoff)
+    + (BXOFF(nv) + MINVECT_SIZE) * (int64_t)sizeof (*xadjstore);
+  int64_t k;
+
+  sz = (nv+1) * sizeof (*xoff);
+  if (!(xoff = xmalloc_large (sz)))
+    return -1;
+  xoff[0] = 0;
+  for (k = 0; k < nv; ++k)
+    xoff[k+1] = xoff[k] + BXENDOFF(k) - BXOFF(k);
+  if (!(xadj = xmalloc_large_ext ((xoff[nv] > 0? xoff[nv] : 1) * sizeof (*xadj)))) {
+    xfree_large (xoff);
+    return -1;
+  }
+  for (k = 0; k < nv; ++k)
+    memcpy (&xadj[XOFF(k)], &bxadj[BXOFF(k)],
+	    (XENDOFF(k) - XOFF(k)) * sizeof (*xadj));
+  xfree_large (xadjstore);
+  xfree_large (bxoff);
+  report_result ("csr_compact_saved_bytes: %" PRId64,
+		 old_bytes - (int64_t)sz - xoff[nv] * (int64_t)sizeof (*xadj));
+  return 0;
+}
+
 int 
 create_graph_from_edgelist (struct packed_edge *IJ, int64_t nedge)
 {
+  const char *snapname = getenv ("CSR_SNAPSHOT");
+
+  if (snapname
+      && !csr_snapshot_map (snapname, nedge, sizeof (*xadj), &snap)) {
+    nv = snap.nv;
+    maxvtx = nv-1;
+    xoff = (int64_t*)snap.off;
+    xadj = (int64_t*)snap.adj;
+    sz = (nv+1) * sizeof (*xoff);
+    report_result ("csr_snapshot: loaded");
+    setup_prefetch ();
+    return 0;
+  }
   find_nv (IJ, nedge);
   if (alloc_graph (nedge)) return -1;
   if (setup_deg_off (IJ, nedge)) {
-    xfree_large (xoff);
+    xfree_large (bxoff);
     return -1;
   }
   gather_edges (IJ, nedge);
+  if (compact_graph ()) {
+    xfree_large (xadjstore);
+    xfree_large (bxoff);
+    return -1;
+  }
+  if (snapname
+      && !csr_snapshot_write (snapname, nedge, sizeof (*xadj), nv, xoff, xadj))
+    report_result ("csr_snapshot: written");
+  setup_prefetch ();
   return 0;
 }
 
+/* Prefetch for expanding vlist[k], with vlist[0..n) filled so far;
+   see prefetch.h. */
+static inline void
+prefetch_ahead (const int64_t * restrict vlist, int64_t k, int64_t n,
+		const int64_t * restrict bfs_tree)
+{
+  if (k + pf.vtx < n)
+    PREFETCH (&xoff[vlist[k + pf.vtx]]);
+  if (k + pf.vtx/2 < n)
+    PREFETCH (&xadj[XOFF(vlist[k + pf.vtx/2])]);
+  if (k + pf.vtx/4 < n) {
+    const int64_t u = vlist[k + pf.vtx/4];
+    const int64_t e = (XENDOFF(u) - XOFF(u) < pf.nbr? XENDOFF(u) : XOFF(u) + pf.nbr);
+    for (int64_t i = XOFF(u); i < e; ++i)
+      PREFETCH (&bfs_tree[xadj[i]]);
+  }
+}
+
 int
 make_bfs_tree (int64_t *bfs_tree_out, int64_t *max_vtx_out,
 	       int64_t srcvtx)
@@ -184,19 +256,33 @@ make_bfs_tree (int64_t *bfs_tree_out, int64_t *max_vtx_out,
   k1 = 0; k2 = 1;
   while (k1 != k2) {
     const int64_t oldk2 = k2;
-    int64_t k;
+    int64_t k, checked = 0;
+    double t = 0;
+    if (bfs_trace_on) t = timestamp ();
     for (k = k1; k < oldk2; ++k) {
       const int64_t v = vlist[k];
       const int64_t veo = XENDOFF(v);
       int64_t vo;
+      if (pf.vtx) prefetch_ahead (vlist, k, k2, bfs_tree);
+      checked += veo - XOFF(v);
       for (vo = XOFF(v); vo < veo; ++vo) {
 	const int64_t j = xadj[vo];
+	if (pf.nbr && vo + pf.nbr < veo) PREFETCH (&bfs_tree[xadj[vo + pf.nbr]]);
 	if (bfs_tree[j] == -1) {
 	  bfs_tree[j] = v;
 	  vlist[k2++] = j;
 	}
       }
     }
+    if (bfs_trace_on) {
+      struct bfs_trace_level lvl;
+      lvl.dir = BFS_TRACE_TOP_DOWN;
+      lvl.frontier = oldk2 - k1;
+      lvl.scout = lvl.checked = checked;
+      lvl.awake = k2 - oldk2;
+      lvl.time = timestamp () - t;
+      bfs_trace_level (&lvl, &lvl.time, &checked, 1);
+    }
     k1 = oldk2;
   }
 
@@ -205,6 +291,49 @@ make_bfs_tree (int64_t *bfs_tree_out, int64_t *max_vtx_out,
   return err;
 }
 
+/* Roots for BFS_PREFETCH=auto, spread over the vertices with
+   neighbors. */
+#define TUNE_NROOT 2
+
+struct tune_arg {
+  int64_t *tree;
+  int64_t root[TUNE_NROOT];
+};
+
+static double
+tune_run (void *p)
+{
+  struct tune_arg *arg = p;
+  int64_t k, maxv;
+  double t = timestamp ();
+  for (k = 0; k < TUNE_NROOT; ++k)
+    make_bfs_tree (arg->tree, &maxv, arg->root[k]);
+  return timestamp () - t;
+}
+
+static void
+setup_prefetch (void)
+{
+  const char *s = getenv ("BFS_PREFETCH");
+  struct tune_arg arg;
+
+  if (!s || strcmp (s, "auto")) {
+    prefetch_setup (&pf, NULL, NULL);
+    return;
+  }
+  if (tune_roots (nv, xoff, TUNE_NROOT, arg.root)) {
+    fprintf (stderr, "No vertex has neighbors, not tuning.\n");
+    prefetch_setup (&pf, NULL, NULL);
+    return;
+  }
+  if (!(arg.tree = xmalloc_large (nv * sizeof (*arg.tree)))) {
+    prefetch_setup (&pf, NULL, NULL);
+    return;
+  }
+  prefetch_setup (&pf, tune_run, &arg);
+  xfree_large (arg.tree);
+}
+
 void
 destroy_graph (void)
 {
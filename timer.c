@@ -72,3 +72,22 @@ toc (void)
 
   return out;
 }
+
+double
+timestamp (void)
+{
+#if defined(__MTA__)
+  MTA("mta fence")
+  return ((double)mta_get_clock (0)) * mta_clock_period ();
+#elif defined(HAVE_MACH_ABSOLUTE_TIME)
+  static mach_timebase_info_data_t info = {0,0};
+  if (info.denom == 0) {
+    mach_timebase_info(&info);
+  }
+  return 1.0e-9 * (mach_absolute_time () * (info.numer / info.denom));
+#else
+  struct timespec ts;
+  clock_gettime (TICTOC_CLOCK, &ts);
+  return ts.tv_sec + 1.0e-9 * ts.tv_nsec;
+#endif
+}
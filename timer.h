@@ -10,6 +10,10 @@ void tic (void);
 /** Return seconds since last tic. */
 double toc (void);
 
+/** Return a timestamp in seconds, for timing intervals without
+    disturbing an enclosing tic/toc. */
+double timestamp (void);
+
 /** Macro to time a block. */
 #define TIME(timevar, what) do { tic (); what; timevar = toc(); } while (0)
 
@@ -0,0 +1,31 @@
+/* -*- mode: C; mode: folding; fill-column: 70; -*- */
+/* See COPYING for license. */
+#include "compat.h"
+
+#include "tune.h"
+
+/* A few pseudo-random draws per root, then the next vertex with
+   neighbors after the last draw. */
+#define TUNE_DRAWS 64
+
+int
+tune_roots (int64_t nv, const int64_t *xoff, int nroot, int64_t *root)
+{
+  uint64_t h = 0x9e3779b97f4a7c15ULL;
+  int64_t r = 0, k;
+  int i, j;
+
+  if (nv < 1) return -1;
+  for (i = 0; i < nroot; ++i) {
+    for (j = 0; j < TUNE_DRAWS; ++j) {
+      h = h * 6364136223846793005ULL + 1442695040888963407ULL;
+      r = (h >> 17) % nv;
+      if (xoff[r+1] > xoff[r]) break;
+    }
+    for (k = 0; j == TUNE_DRAWS && k < nv; ++k, r = (r + 1) % nv)
+      if (xoff[r+1] > xoff[r]) break;
+    if (k == nv) return -1;
+    root[i] = r;
+  }
+  return 0;
+}
@@ -0,0 +1,16 @@
+/* -*- mode: C; mode: folding; fill-column: 70; -*- */
+/* See COPYING for license. */
+#if !defined(TUNE_HEADER_)
+#define TUNE_HEADER_
+
+#include "compat.h"
+
+/* Helpers for the implementations' startup tuning runs (BFS_TUNE,
+   BFS_PREFETCH=auto). */
+
+/** Fill root[0..nroot) with vertices that have neighbors in the CSR
+    graph with offsets xoff[0..nv], the same ones on every call, for
+    timing runs.  Returns -1 if no vertex has neighbors. */
+int tune_roots (int64_t nv, const int64_t *xoff, int nroot, int64_t *root);
+
+#endif /* TUNE_HEADER_ */
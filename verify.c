@@ -12,6 +12,7 @@
 #include <assert.h>
 
 #include "xalloc.h"
+#include "bitmap.h"
 #include "verify.h"
 
 static int
@@ -86,7 +87,8 @@ verify_bfs_tree (int64_t *bfs_tree_in, int64_t max_bfsvtx,
 
   int err;
   int64_t nedge_traversed;
-  int64_t * restrict seen_edge, * restrict level;
+  int64_t * restrict level;
+  bitmap_t seen_edge;
 
   const int64_t nv = max_bfsvtx+1;
 
@@ -100,8 +102,11 @@ verify_bfs_tree (int64_t *bfs_tree_in, int64_t max_bfsvtx,
 
   err = 0;
   nedge_traversed = 0;
-  seen_edge = xmalloc_large (2 * (nv) * sizeof (*seen_edge));
-  level = &seen_edge[nv];
+  level = xmalloc_large (nv * sizeof (*level));
+  if (bm_alloc (&seen_edge, nv)) {
+    xfree_large (level);
+    return -998;
+  }
 
   err = compute_levels (level, nv, bfs_tree, root);
 
@@ -110,9 +115,7 @@ verify_bfs_tree (int64_t *bfs_tree_in, int64_t max_bfsvtx,
   OMP("omp parallel shared(err)") {
     int64_t k;
     int terr = 0;
-    OMP("omp for")
-      for (k = 0; k < nv; ++k)
-	seen_edge[k] = 0;
+    bm_reset (&seen_edge);
 
     OMP("omp for reduction(+:nedge_traversed)")
     MTA("mta assert parallel") MTA("mta use 100 streams")
@@ -145,9 +148,9 @@ verify_bfs_tree (int64_t *bfs_tree_in, int64_t max_bfsvtx,
 	/* Mark seen tree edges. */
 	if (i != j) {
 	  if (bfs_tree[i] == j)
-	    seen_edge[i] = 1;
+	    bm_set_bit_atomic (&seen_edge, i);
 	  if (bfs_tree[j] == i)
-	    seen_edge[j] = 1;
+	    bm_set_bit_atomic (&seen_edge, j);
 	}
 	lvldiff = level[i] - level[j];
 	/* Check that the levels differ by no more than one. */
@@ -162,7 +165,7 @@ verify_bfs_tree (int64_t *bfs_tree_in, int64_t max_bfsvtx,
 	for (k = 0; k < nv; ++k) {
 	  terr = err;
 	  if (!terr && k != root) {
-	    if (bfs_tree[k] >= 0 && !seen_edge[k])
+	    if (bfs_tree[k] >= 0 && !bm_get_bit (&seen_edge, k))
 	      terr = -15;
 	    if (bfs_tree[k] == k)
 	      terr = -16;
@@ -173,7 +176,8 @@ verify_bfs_tree (int64_t *bfs_tree_in, int64_t max_bfsvtx,
   }
  done:
 
-  xfree_large (seen_edge);
+  bm_free (&seen_edge);
+  xfree_large (level);
   if (err) return err;
   return nedge_traversed;
 }